@@ -35,45 +35,268 @@ void BinjaLog(BNLogLevel level, const String& format, const Args&... args)
 }
 
 #include <mem/mem.h>
+#include <mem/pattern.h>
+
+#include <algorithm>
+#include <cstring>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+#include "ParallelFunctions.h"
+#include "SimdScanner.h"
 
 namespace brick
 {
+    // Size of the chunks each segment is split into when scanning in parallel
+    constexpr const size_t parallel_scan_partition = 4 * 1024 * 1024;
+
+    // Granularity at which changes to a view are re-read
+    constexpr const uint64_t view_page_size = 0x1000;
+
+    struct address_range
+    {
+        uint64_t start;
+        uint64_t end;
+    };
+
+    // Sorts and merges overlapping or adjacent ranges
+    void merge_ranges(std::vector<address_range>& ranges);
+
+    // A fast, non-cryptographic hash, used to detect changes to cached data
+    uint64_t hash_bytes(const void* data, size_t length, uint64_t seed = 0);
+
     struct view_segment
     {
         uint64_t start;
         uint64_t length;
-        std::unique_ptr<uint8_t[]> data;
 
-        view_segment(Ref<BinaryView> view, uint64_t start, uint64_t length);
+        // Number of bytes backed by data. The rest of the segment is zero, and isn't stored.
+        uint64_t data_length;
+        const uint8_t* data {nullptr};
+
+        // Only set if the segment had to be copied out of the view.
+        // Shared between snapshots until the segment changes.
+        std::shared_ptr<uint8_t> buffer;
+
+        // Reads the segment from the view
+        view_segment(Ref<BinaryView> view, uint64_t start, uint64_t length, uint64_t data_length);
+
+        // Uses data owned by someone else (e.g. a mapped file)
+        view_segment(uint64_t start, uint64_t length, uint64_t data_length, const uint8_t* data);
+
+        // Copies previous, then reads the dirty ranges again from the view
+        view_segment(Ref<BinaryView> view, const view_segment& previous, const std::vector<address_range>& dirty);
     };
 
+    struct segment_layout
+    {
+        uint64_t start;
+        uint64_t length;
+        uint64_t data_length;
+    };
+
+    // Returns the bounds of each segment, or of the whole view if it has none
+    std::vector<segment_layout> get_segment_layout(Ref<BinaryView> view);
+
+    // Returns the sorted and merged ranges covered by the view's segments
+    std::vector<address_range> view_ranges(Ref<BinaryView> view);
+
+    // A contiguous part of a snapshot to be scanned
+    struct view_region
+    {
+        uint64_t start;
+        const uint8_t* data;
+        size_t length;
+
+        // Number of zero bytes following data, which aren't stored
+        uint64_t zero_length;
+    };
+
+    // Returns whether the pattern matches a run of zeros
+    bool matches_zero(const mem::pattern& pattern);
+
+    // Restricts a scan to part of a view. An empty scope covers every segment.
+    struct scan_scope
+    {
+        // Segments marked as executable
+        bool executable {false};
+
+        std::vector<std::string> sections;
+        std::vector<address_range> ranges;
+
+        // The text each of ranges was parsed from, in case it's actually the name of a section
+        std::vector<std::string> range_names;
+
+        // Parses a comma separated list of "executable", section names (".text")
+        // and end-exclusive address ranges ("0x1000-0x2000").
+        // Fails if a range is empty. Anything else which isn't a valid range (e.g. an address which doesn't fit in
+        // 64 bits) is taken as a section name.
+        bool parse(const std::string& text);
+
+        bool empty() const;
+
+        // Returns the sorted and merged address ranges covered by the scope, clipped to the view's segments.
+        // A section whose name looks like a range takes precedence over the range.
+        // Only matches lying entirely inside one of the ranges are found, so a match which starts inside a range but
+        // ends after it is not.
+        std::vector<address_range> resolve(Ref<BinaryView> view) const;
+    };
+
+    // Doesn't keep a reference to the view, so a cached snapshot doesn't keep a closed view alive
     struct view_data
     {
-        Ref<BinaryView> view;
+        // Backing file for segments which could be used as-is
+        std::shared_ptr<mapped_file> file;
+
         std::vector<view_segment> segments;
 
+    private:
+        mutable std::once_flag histogram_once_;
+        mutable std::unique_ptr<byte_histogram> histogram_;
+
+        mutable std::once_flag content_hash_once_;
+        mutable uint64_t content_hash_ {0};
+
+    public:
         view_data(Ref<BinaryView> view);
 
+        // Uses segments read elsewhere (e.g. from a cache on disk), kept alive by file
+        view_data(std::shared_ptr<mapped_file> file, std::vector<view_segment> segments,
+            std::unique_ptr<byte_histogram> histogram);
+
+        // Reuses every page of previous outside of the dirty ranges, and reads the rest from the view
+        view_data(Ref<BinaryView> view, const view_data& previous, std::vector<address_range> dirty);
+
+        // Copies [address, address + length) out of the snapshot, including any zero runs.
+        // Fails if the range isn't inside a single segment.
+        bool read(uint64_t address, void* buffer, size_t length) const;
+
+        // Byte frequencies of every segment, counted on first use
+        const byte_histogram& histogram() const;
+
+        // Hash of the layout and contents of every segment, computed on first use
+        uint64_t content_hash() const;
+
+        // Every segment
+        std::vector<view_region> regions() const;
+
+        // The parts of every segment inside the (sorted and merged) ranges
+        std::vector<view_region> regions(const std::vector<address_range>& ranges) const;
+
+        // Scans a single region, including any matches in or crossing into its zero run.
+        // Returns true if pred asked to stop.
+        template <typename Scanner, typename UnaryPredicate>
+        static bool scan_region(
+            const view_region& region, const mem::pattern& pattern, const Scanner& scanner, UnaryPredicate pred)
+        {
+            bool stop = false;
+
+            if (region.length != 0)
+            {
+                scanner(mem::region {region.data, region.length}, [&](mem::pointer result) {
+                    stop = pred(region.start + static_cast<uint64_t>(result.as<const uint8_t*>() - region.data));
+
+                    return stop;
+                });
+
+                if (stop)
+                {
+                    return true;
+                }
+            }
+
+            return scan_zero_run(region, pattern, scanner, pred);
+        }
+
+        // Scans the zero run following a region, without reading or allocating it
         template <typename Scanner, typename UnaryPredicate>
-        void operator()(const Scanner& scanner, UnaryPredicate pred) const
+        static bool scan_zero_run(
+            const view_region& region, const mem::pattern& pattern, const Scanner& scanner, UnaryPredicate pred)
         {
-            for (const view_segment& segment : segments)
+            const size_t size = pattern.size();
+
+            if ((region.zero_length == 0) || (size == 0))
+            {
+                return false;
+            }
+
+            const uint64_t zero_start = region.start + region.length;
+
+            // Matches which start in the data, but end in the zero run
+            const size_t tail_length = std::min<size_t>(size - 1, region.length);
+
+            if (tail_length != 0)
             {
-                mem::region range {segment.data.get(), segment.length};
+                const size_t zero_length = static_cast<size_t>(std::min<uint64_t>(size - 1, region.zero_length));
+
+                std::vector<uint8_t> boundary(tail_length + zero_length);
+
+                std::memcpy(boundary.data(), region.data + region.length - tail_length, tail_length);
+
+                bool stop = false;
 
-                scanner(range,
-                    [&](mem::pointer result) { return
-					pred(result.shift(range.start, segment.start).as<uintptr_t>()); });
+                scanner(mem::region {boundary.data(), boundary.size()}, [&](mem::pointer result) {
+                    const size_t offset = static_cast<size_t>(result.as<const uint8_t*>() - boundary.data());
+
+                    // Anything starting in the zero run is handled below
+                    if (offset < tail_length)
+                    {
+                        stop = pred(zero_start - tail_length + offset);
+                    }
+
+                    return stop;
+                });
+
+                if (stop)
+                {
+                    return true;
+                }
+            }
+
+            if ((region.zero_length < size) || !matches_zero(pattern))
+            {
+                return false;
             }
+
+            for (uint64_t addr = zero_start, end = zero_start + region.zero_length - size; addr <= end; ++addr)
+            {
+                if (pred(addr))
+                {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        template <typename Scanner, typename UnaryPredicate>
+        void operator()(const std::vector<view_region>& regions, const mem::pattern& pattern, const Scanner& scanner,
+            UnaryPredicate pred) const
+        {
+            for (const view_region& region : regions)
+            {
+                if (scan_region(region, pattern, scanner, pred))
+                {
+                    break;
+                }
+            }
+        }
+
+        template <typename Scanner, typename UnaryPredicate>
+        void operator()(const mem::pattern& pattern, const Scanner& scanner, UnaryPredicate pred) const
+        {
+            (*this)(regions(), pattern, scanner, pred);
         }
 
         template <typename Scanner>
-        uint64_t scan(const Scanner& scanner) const
+        uint64_t scan(const mem::pattern& pattern, const Scanner& scanner) const
         {
             uint64_t result = 0;
 
-            (*this)(scanner, [&](uint64_t addr) -> bool {
+            (*this)(pattern, scanner, [&](uint64_t addr) -> bool {
                 result = addr;
 
                 return true;
@@ -83,11 +306,12 @@ namespace brick
         }
 
         template <typename Scanner>
-        std::vector<uint64_t> scan_all(const Scanner& scanner) const
+        std::vector<uint64_t> scan_all(
+            const std::vector<view_region>& regions, const mem::pattern& pattern, const Scanner& scanner) const
         {
             std::vector<uint64_t> results;
 
-            (*this)(scanner, [&results](uint64_t addr) -> bool {
+            (*this)(regions, pattern, scanner, [&results](uint64_t addr) -> bool {
                 results.emplace_back(addr);
 
                 return false;
@@ -95,5 +319,68 @@ namespace brick
 
             return results;
         }
+
+        template <typename Scanner>
+        std::vector<uint64_t> scan_all(const mem::pattern& pattern, const Scanner& scanner) const
+        {
+            return scan_all(regions(), pattern, scanner);
+        }
+
+        // Splits each region into overlapping chunks and scans them on all cores.
+        // Results are returned sorted by address, matching scan_all.
+        template <typename Scanner>
+        std::vector<uint64_t> scan_all_parallel(
+            const std::vector<view_region>& regions, const mem::pattern& pattern, const Scanner& scanner) const
+        {
+            std::vector<uint64_t> results;
+            std::mutex results_lock;
+
+            const size_t overlap = (pattern.size() != 0) ? (pattern.size() - 1) : 0;
+
+            for (const view_region& region : regions)
+            {
+                parallel_partition(region.length, parallel_scan_partition, overlap, [&](size_t offset, size_t length) {
+                    // Matches starting in the overlap belong to the next chunk
+                    const size_t owned_end = offset + parallel_scan_partition;
+
+                    std::vector<uint64_t> sub_results;
+
+                    scanner(mem::region {region.data + offset, length}, [&](mem::pointer result) {
+                        const size_t result_offset = static_cast<size_t>(result.as<const uint8_t*>() - region.data);
+
+                        if (result_offset < owned_end)
+                        {
+                            sub_results.emplace_back(region.start + result_offset);
+                        }
+
+                        return false;
+                    });
+
+                    if (!sub_results.empty())
+                    {
+                        std::lock_guard<std::mutex> guard(results_lock);
+
+                        results.insert(results.end(), sub_results.begin(), sub_results.end());
+                    }
+
+                    return true;
+                });
+
+                scan_zero_run(region, pattern, scanner, [&](uint64_t addr) {
+                    results.emplace_back(addr);
+
+                    return false;
+                });
+            }
+
+            std::sort(results.begin(), results.end());
+
+            return results;
+        }
+        template <typename Scanner>
+        std::vector<uint64_t> scan_all_parallel(const mem::pattern& pattern, const Scanner& scanner) const
+        {
+            return scan_all_parallel(regions(), pattern, scanner);
+        }
     };
 } // namespace brick
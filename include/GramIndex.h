@@ -0,0 +1,75 @@
+/*
+    Copyright 2018 Brick
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+    and associated documentation files (the "Software"), to deal in the Software without restriction,
+    including without limitation the rights to use, copy, modify, merge, publish, distribute,
+    sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all copies or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+    BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include "BinaryNinja.h"
+
+namespace brick
+{
+    // Maps every 4 byte gram of a snapshot to the positions it occurs at, so patterns containing 4 consecutive known
+    // bytes can be found without reading the whole view.
+    // Grams are hashed into buckets, and each chunk of each segment keeps its own delta encoded posting lists.
+    class gram_index
+    {
+    private:
+        struct index_chunk
+        {
+            // Index into regions_, and the positions of the region covered by this chunk
+            size_t region;
+            size_t offset;
+            size_t length;
+
+            // Start of each bucket's postings, plus one past the end
+            std::vector<uint32_t> buckets;
+
+            // Varint encoded distances between successive positions in a bucket
+            std::vector<uint8_t> postings;
+        };
+
+        std::shared_ptr<const view_data> data_;
+        std::vector<view_region> regions_;
+        std::vector<index_chunk> chunks_;
+
+        // Number of positions in each bucket, over every chunk
+        std::vector<uint64_t> counts_;
+
+        void build_chunk(index_chunk& chunk) const;
+
+        void decode(const index_chunk& chunk, uint32_t bucket, std::vector<size_t>& positions) const;
+
+    public:
+        gram_index(std::shared_ptr<const view_data> data);
+
+        // The snapshot this index was built from
+        const std::shared_ptr<const view_data>& data() const noexcept
+        {
+            return data_;
+        }
+
+        // Memory used by the posting lists
+        size_t size_in_bytes() const;
+
+        // Finds every match of the pattern inside regions (which must come from data()), sorted by address.
+        // Returns false if the pattern has no 4 consecutive known bytes to look up.
+        // Chunks are looked up on every core if parallel is set, otherwise only on the calling thread.
+        bool scan_all(const std::vector<view_region>& regions, const mem::pattern& pattern,
+            const simd_scanner& scanner, std::vector<uint64_t>& results, bool parallel) const;
+    };
+} // namespace brick
@@ -0,0 +1,80 @@
+/*
+    Copyright 2018 Brick
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+    and associated documentation files (the "Software"), to deal in the Software without restriction,
+    including without limitation the rights to use, copy, modify, merge, publish, distribute,
+    sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all copies or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+    BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include "BinaryNinja.h"
+#include "SimdScanner.h"
+
+namespace brick
+{
+    // Finds the matches of many patterns in a single pass over the data.
+    // Each pattern is anchored on its rarest literal run of 4 (or failing that, 2) bytes, and every position of the
+    // data is looked up in a hash table of those anchors. The full (masked) pattern is only checked on an anchor hit.
+    // Patterns without 2 consecutive known bytes are scanned separately with a simd_scanner.
+    class multi_scanner
+    {
+    private:
+        struct anchor_entry
+        {
+            uint32_t gram;
+            uint32_t pattern;
+            uint32_t offset;
+        };
+
+        std::vector<mem::pattern> patterns_;
+        std::vector<simd_scanner> scanners_;
+
+        size_t max_size_ {0};
+
+        // 4 byte anchors, bucketed by a multiplicative hash
+        std::vector<uint32_t> gram4_offsets_;
+        std::vector<anchor_entry> gram4_entries_;
+        std::vector<uint64_t> gram4_filter_;
+        unsigned gram4_shift_ {32};
+
+        // 2 byte anchors, indexed directly
+        std::vector<uint32_t> gram2_offsets_;
+        std::vector<anchor_entry> gram2_entries_;
+
+        std::vector<uint32_t> unanchored_;
+
+        // Scans [begin, end) of region, keeping matches which start before own_end and end after skip
+        void scan_chunk(const view_region& region, size_t begin, size_t end, size_t own_end, size_t skip,
+            std::vector<std::pair<uint32_t, uint64_t>>& results) const;
+
+        std::vector<std::vector<uint64_t>> collect(std::vector<std::pair<uint32_t, uint64_t>>& matches) const;
+
+    public:
+        // Anchors are chosen using the frequencies of the data being scanned, if known
+        multi_scanner(std::vector<mem::pattern> patterns, const byte_histogram* histogram = nullptr);
+
+        size_t size() const noexcept
+        {
+            return patterns_.size();
+        }
+
+        // Scans every region on all cores. Returns the sorted matches of each pattern, in the order they were given.
+        std::vector<std::vector<uint64_t>> scan_all(const std::vector<view_region>& regions) const;
+
+        // Scans the ranges of the view a chunk at a time, see stream_view
+        std::vector<std::vector<uint64_t>> stream_scan_all(
+            Ref<BinaryView> view, const std::vector<address_range>& ranges) const;
+    };
+} // namespace brick
@@ -21,6 +21,7 @@
 
 #include <cstdint>
 
+#include <algorithm>
 #include <atomic>
 #include <mutex>
 #include <thread>
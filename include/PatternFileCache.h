@@ -0,0 +1,76 @@
+/*
+    Copyright 2018 Brick
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+    and associated documentation files (the "Software"), to deal in the Software without restriction,
+    including without limitation the rights to use, copy, modify, merge, publish, distribute,
+    sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all copies or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+    BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace brick
+{
+    // An entry of a pattern file, with its pattern and ops already compiled
+    struct compiled_pattern
+    {
+        std::string name;
+        std::string type;
+        std::string pattern_string;
+
+        bool has_ops {false};
+        std::string ops_string;
+
+        // Scope strings for the entry, instead of the file's default scope
+        bool has_scope {false};
+        std::vector<std::string> scope;
+
+        uint64_t count {1};
+        uint64_t index {0};
+
+        // Errors found while parsing or compiling the entry. Entries with any errors aren't scanned.
+        std::vector<std::string> errors;
+
+        std::vector<uint8_t> bytes;
+        std::vector<uint8_t> masks;
+
+        // See mem::sm::program
+        std::vector<uint64_t> code;
+        uint64_t stack_size {0};
+
+        // Names of the other patterns referenced by the ops, in the order of their symbols
+        std::vector<std::string> references;
+    };
+
+    struct compiled_pattern_file
+    {
+        // Hash of the contents of the YAML file
+        uint64_t hash {0};
+
+        std::vector<std::string> scope;
+        std::vector<compiled_pattern> patterns;
+    };
+
+    // Returns whether the "pattern.cachePatternFiles" setting is enabled
+    bool is_pattern_cache_enabled();
+
+    // Maps the compiled form of a pattern file, if it was saved from the same contents and modification time
+    bool load_pattern_cache(const std::string& file_name, uint64_t hash, compiled_pattern_file& compiled);
+
+    // Writes the compiled form of a pattern file to the cache directory
+    bool save_pattern_cache(const std::string& file_name, const compiled_pattern_file& compiled);
+} // namespace brick
@@ -21,4 +21,13 @@
 
 #include "BinaryNinja.h"
 
-void GenerateSignature(Ref<BinaryView> view, uint64_t addr);
\ No newline at end of file
+void GenerateSignature(Ref<BinaryView> view, uint64_t addr);
+
+// Creates a signature which matches exactly once in each of the selected open views, ignoring bytes which differ
+void GenerateCrossSignature(Ref<BinaryView> view, uint64_t addr);
+
+// Writes a pattern file with a signature for every function
+void GenerateAllSignatures(Ref<BinaryView> view);
+
+// Writes a pattern file with a signature for every function starting inside the range
+void GenerateRangeSignatures(Ref<BinaryView> view, uint64_t addr, uint64_t len);
\ No newline at end of file
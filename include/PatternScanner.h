@@ -32,4 +32,8 @@ extern "C"
 
     BINARYNINJAPLUGIN size_t BinaryPattern_Scan(
         BinaryPattern* pattern, const uint8_t* data, size_t length, size_t* values, size_t limit);
+
+    // Scans the parts of a view matched by scope (see brick::scan_scope, may be NULL to scan everything)
+    BINARYNINJAPLUGIN size_t BinaryPattern_ScanView(
+        BinaryPattern* pattern, BNBinaryView* view, const char* scope, uint64_t* values, size_t limit);
 }
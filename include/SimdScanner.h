@@ -0,0 +1,161 @@
+/*
+    Copyright 2018 Brick
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+    and associated documentation files (the "Software"), to deal in the Software without restriction,
+    including without limitation the rights to use, copy, modify, merge, publish, distribute,
+    sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all copies or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+    BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <mem/mem.h>
+#include <mem/pattern.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace brick
+{
+    // How often each byte, and each pair of adjacent bytes, occurs in some data
+    struct byte_histogram
+    {
+        uint64_t total {0};
+
+        // Indexed by byte value
+        std::vector<uint64_t> bytes;
+
+        // Indexed by first | (second << 8)
+        std::vector<uint64_t> pairs;
+
+        byte_histogram();
+
+        void add(const uint8_t* data, size_t length);
+        void add_zeros(uint64_t length);
+
+        void merge(const byte_histogram& other);
+
+        uint64_t pair(uint8_t first, uint8_t second) const noexcept
+        {
+            return pairs[first | (size_t(second) << 8)];
+        }
+
+        // Estimated number of times the two bytes occur distance bytes apart
+        double estimate(uint8_t first, uint8_t second, size_t distance) const;
+    };
+
+    // Approximate frequencies of bytes in typical executables, for when the data to be scanned isn't known up front
+    const byte_histogram& typical_byte_histogram();
+
+    // Instruction sets simd_scanner can use, from narrowest to widest
+    enum class simd_level
+    {
+        scalar,
+        sse2,
+        avx2,
+        avx512,
+    };
+
+    // The widest level supported by the CPU
+    simd_level supported_simd_level();
+
+    const char* to_string(simd_level level);
+
+    // Searches for the two rarest fully known bytes of a pattern, 16-64 positions at a time,
+    // and only checks the whole (masked) pattern where both of them match.
+    // Uses the widest of SSE2, AVX2 and AVX-512 supported by the CPU (or by level), falling back to plain C++.
+    class simd_scanner
+    {
+    private:
+        std::vector<uint8_t> bytes_;
+        std::vector<uint8_t> masks_;
+
+        // Offsets of the anchor bytes
+        size_t anchors_[2] {};
+
+        // False if the pattern has no fully known bytes to anchor on
+        bool anchored_ {false};
+
+        simd_level level_ {simd_level::scalar};
+
+    public:
+        simd_scanner() = default;
+
+        // Anchors are chosen using the frequencies of the data being scanned, if known.
+        // level limits the instruction sets used, mainly so tests can cover each of them.
+        simd_scanner(const mem::pattern& pattern, const byte_histogram* histogram = nullptr,
+            simd_level level = supported_simd_level());
+
+        template <typename UnaryPredicate>
+        mem::pointer operator()(mem::region range, UnaryPredicate pred) const
+        {
+            const size_t size = bytes_.size();
+
+            if ((size == 0) || (range.size < size))
+            {
+                return nullptr;
+            }
+
+            const uint8_t* current = range.start.as<const uint8_t*>();
+            const uint8_t* const end = current + (range.size - size + 1);
+
+            while ((current = find(current, end)) != nullptr)
+            {
+                if (pred(mem::pointer(current)))
+                {
+                    return mem::pointer(current);
+                }
+
+                ++current;
+            }
+
+            return nullptr;
+        }
+
+        // Returns the first position in [begin, end) the pattern matches at, or nullptr.
+        // All size() bytes following end - 1 must be readable.
+        const uint8_t* find(const uint8_t* begin, const uint8_t* end) const;
+
+        // Returns whether the pattern matches at data
+        bool verify(const uint8_t* data) const;
+
+        // Expected number of positions per byte scanned where the anchors match and the whole pattern must be checked.
+        // Every position is checked if the pattern has no known bytes.
+        double estimate_hit_rate(const byte_histogram& histogram) const;
+
+        size_t size() const noexcept
+        {
+            return bytes_.size();
+        }
+
+        const size_t* anchors() const noexcept
+        {
+            return anchors_;
+        }
+
+        bool anchored() const noexcept
+        {
+            return anchored_;
+        }
+
+        simd_level level() const noexcept
+        {
+            return level_;
+        }
+
+        const uint8_t* bytes() const noexcept
+        {
+            return bytes_.data();
+        }
+    };
+} // namespace brick
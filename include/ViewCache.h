@@ -0,0 +1,52 @@
+/*
+    Copyright 2018 Brick
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+    and associated documentation files (the "Software"), to deal in the Software without restriction,
+    including without limitation the rights to use, copy, modify, merge, publish, distribute,
+    sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all copies or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+    BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include "BinaryNinja.h"
+#include "GramIndex.h"
+
+namespace brick
+{
+    // Returns a snapshot of the view shared by every command.
+    // Pages which were written, inserted or removed since the last call are read again, the rest is reused.
+    std::shared_ptr<const view_data> get_view_data(Ref<BinaryView> view);
+
+    // Returns the index of the snapshot if it has been built, and the "pattern.indexView" setting is enabled.
+    // Otherwise starts building it in the background, and returns null so the caller can scan linearly for now.
+    std::shared_ptr<const gram_index> get_gram_index(
+        Ref<BinaryView> view, const std::shared_ptr<const view_data>& data);
+
+    // Remembers a view once its initial analysis completes, without keeping it open, until it is released
+    void register_open_view(BinaryView* view);
+
+    // Returns every view which has been opened and not yet closed
+    std::vector<Ref<BinaryView>> get_open_views();
+
+    // Drops the cached snapshot and stops listening for changes to the view
+    void release_view_data(BinaryView* view);
+
+    // Releases the data of each view once the core destroys it.
+    // The finalization event fires once a view is initialized, not when it closes, so it can't be used for this.
+    class view_cache_destructor : public ObjectDestructor
+    {
+    public:
+        void DestructBinaryView(BinaryView* view) override;
+    };
+} // namespace brick
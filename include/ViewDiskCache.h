@@ -0,0 +1,37 @@
+/*
+    Copyright 2018 Brick
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+    and associated documentation files (the "Software"), to deal in the Software without restriction,
+    including without limitation the rights to use, copy, modify, merge, publish, distribute,
+    sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all copies or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+    BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include "BinaryNinja.h"
+
+namespace brick
+{
+    // Returns whether the "pattern.diskCache" setting is enabled for the view
+    bool is_disk_cache_enabled(Ref<BinaryView> view);
+
+    // Maps the cached snapshot of the view, if there is one matching its current segments, and the size and
+    // modification time of its file. Returns null if there isn't, or the view has unsaved changes.
+    std::shared_ptr<const view_data> load_view_cache(Ref<BinaryView> view);
+
+    // Writes the snapshot, its byte histogram and the hash of every page to the cache directory.
+    // Does nothing if the view has unsaved changes, since the snapshot wouldn't match its file.
+    // Older versions of the view's cache are removed, and then the least recently used caches over the size limit.
+    bool save_view_cache(Ref<BinaryView> view, const view_data& data);
+} // namespace brick
@@ -0,0 +1,63 @@
+/*
+    Copyright 2018 Brick
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+    and associated documentation files (the "Software"), to deal in the Software without restriction,
+    including without limitation the rights to use, copy, modify, merge, publish, distribute,
+    sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all copies or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+    BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include "BinaryNinja.h"
+
+#include <functional>
+
+namespace brick
+{
+    // Returns the most memory a single scan may use for view data, from the pattern.scanMemoryLimit setting
+    uint64_t get_scan_memory_limit(Ref<BinaryView> view);
+
+    // Returns whether scans should be streamed, rather than reading the view into a snapshot.
+    // A snapshot always holds the whole view, so this doesn't depend on how much of it is scanned.
+    bool should_stream(Ref<BinaryView> view);
+
+    // Reads the ranges of the view chunk_size bytes at a time, calling func with each chunk.
+    // Each chunk is prefixed by the last overlap bytes of the previous chunk in the same range (carry_length).
+    // The next chunk is read on another thread while func runs. Stops early if func returns false.
+    void stream_view(Ref<BinaryView> view, const std::vector<address_range>& ranges, size_t chunk_size,
+        size_t overlap, const std::function<bool(const view_region& region, size_t carry_length)>& func);
+
+    // Scans the ranges of the view without holding more than two chunks in memory
+    template <typename Scanner>
+    std::vector<uint64_t> stream_scan_all(Ref<BinaryView> view, const std::vector<address_range>& ranges,
+        const mem::pattern& pattern, const Scanner& scanner)
+    {
+        std::vector<uint64_t> results;
+
+        const size_t overlap = (pattern.size() != 0) ? (pattern.size() - 1) : 0;
+        const size_t chunk_size = static_cast<size_t>(get_scan_memory_limit(view) / 2);
+
+        stream_view(view, ranges, chunk_size, overlap, [&](const view_region& region, size_t /*carry_length*/) {
+            scanner(mem::region {region.data, region.length}, [&](mem::pointer result) {
+                results.emplace_back(region.start + static_cast<uint64_t>(result.as<const uint8_t*>() - region.data));
+
+                return false;
+            });
+
+            return true;
+        });
+
+        return results;
+    }
+} // namespace brick
@@ -28,6 +28,10 @@ _BinaryPattern_Scan = _binarypattern_dll['BinaryPattern_Scan']
 _BinaryPattern_Scan.argtypes = [POINTER(_BinaryPattern), POINTER(c_ubyte), c_size_t, POINTER(c_size_t), c_size_t]
 _BinaryPattern_Scan.restype = c_size_t
 
+_BinaryPattern_ScanView = _binarypattern_dll['BinaryPattern_ScanView']
+_BinaryPattern_ScanView.argtypes = [POINTER(_BinaryPattern), c_void_p, c_char_p, POINTER(c_uint64), c_size_t]
+_BinaryPattern_ScanView.restype = c_size_t
+
 class BinaryPattern:
     def __init__(self, pattern):
         self.handle = _BinaryPattern_Parse(create_string_buffer(pattern.encode('ascii')))
@@ -42,3 +46,12 @@ class BinaryPattern:
             return result.value
         else:
             return None
+
+    # scope: e.g. "executable", ".text, .rdata" or "0x401000-0x402000"
+    def find_in_view(self, view, scope=None):
+        result = c_uint64()
+
+        if _BinaryPattern_ScanView(self.handle, cast(view.handle, c_void_p), scope.encode('ascii') if scope else None, byref(result), c_size_t(1)):
+            return result.value
+        else:
+            return None
@@ -19,36 +19,661 @@
 
 #include "BinaryNinja.h"
 
+#include <mem/utils.h>
+
 namespace brick
 {
-    view_segment::view_segment(Ref<BinaryView> view, uint64_t start_, uint64_t length_)
+    void merge_ranges(std::vector<address_range>& ranges)
+    {
+        if (ranges.empty())
+        {
+            return;
+        }
+
+        std::sort(ranges.begin(), ranges.end(),
+            [](const address_range& lhs, const address_range& rhs) { return lhs.start < rhs.start; });
+
+        size_t count = 1;
+
+        for (size_t i = 1; i < ranges.size(); ++i)
+        {
+            address_range& last = ranges[count - 1];
+
+            if (ranges[i].start <= last.end)
+            {
+                last.end = std::max(last.end, ranges[i].end);
+            }
+            else
+            {
+                ranges[count++] = ranges[i];
+            }
+        }
+
+        ranges.resize(count);
+    }
+
+    uint64_t hash_bytes(const void* data, size_t length, uint64_t seed)
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+        uint64_t hash = (seed ^ UINT64_C(0xCBF29CE484222325)) + length;
+
+        size_t i = 0;
+
+        for (; i + 8 <= length; i += 8)
+        {
+            uint64_t word;
+            std::memcpy(&word, bytes + i, sizeof(word));
+
+            hash = (hash ^ (word * UINT64_C(0x87C37B91114253D5))) * UINT64_C(0x100000001B3);
+            hash ^= hash >> 29;
+        }
+
+        for (; i < length; ++i)
+        {
+            hash = (hash ^ bytes[i]) * UINT64_C(0x100000001B3);
+        }
+
+        hash ^= hash >> 32;
+        hash *= UINT64_C(0xD6E8FEB86659FD93);
+        hash ^= hash >> 32;
+
+        return hash;
+    }
+
+    static std::shared_ptr<uint8_t> allocate_segment_buffer(uint64_t length)
+    {
+        return std::shared_ptr<uint8_t>(new uint8_t[length], std::default_delete<uint8_t[]>());
+    }
+
+    view_segment::view_segment(Ref<BinaryView> view, uint64_t start_, uint64_t length_, uint64_t data_length_)
         : start(start_)
         , length(length_)
-        , data(new uint8_t[length_])
+        , data_length(data_length_)
+        , buffer(allocate_segment_buffer(data_length_))
     {
-        if (view->Read(data.get(), start, length) != length)
+        data = buffer.get();
+
+        if (view->Read(buffer.get(), start, data_length) != data_length)
         {
             // TODO: Handle Errors
         }
     }
 
-    view_data::view_data(Ref<BinaryView> view_)
-        : view(view_)
+    view_segment::view_segment(uint64_t start_, uint64_t length_, uint64_t data_length_, const uint8_t* data_)
+        : start(start_)
+        , length(length_)
+        , data_length(data_length_)
+        , data(data_)
+    {}
+
+    view_segment::view_segment(
+        Ref<BinaryView> view, const view_segment& previous, const std::vector<address_range>& dirty)
+        : start(previous.start)
+        , length(previous.length)
+        , data_length(previous.data_length)
+        , buffer(allocate_segment_buffer(previous.data_length))
+    {
+        data = buffer.get();
+
+        std::memcpy(buffer.get(), previous.data, data_length);
+
+        for (const address_range& range : dirty)
+        {
+            const uint64_t sub_start = std::max(range.start, start);
+            const uint64_t sub_end = std::min(range.end, start + data_length);
+
+            if (sub_start < sub_end)
+            {
+                view->Read(buffer.get() + (sub_start - start), sub_start, sub_end - sub_start);
+            }
+        }
+    }
+
+    // Compares pages spread evenly across the file against the raw view, since the file could have been rebuilt or
+    // patched on disk (even keeping the same size) after the view was opened
+    static bool matches_raw_view(Ref<BinaryView> parent, const mapped_file& file)
+    {
+        constexpr const uint64_t sample_count = 64;
+
+        const uint64_t page_count = (file.size() + view_page_size - 1) / view_page_size;
+
+        std::vector<uint8_t> buffer(view_page_size);
+
+        for (uint64_t i = 0; i < std::min(sample_count, page_count); ++i)
+        {
+            const uint64_t page = (page_count <= sample_count) ? i : ((page_count - 1) * i / (sample_count - 1));
+            const uint64_t offset = page * view_page_size;
+            const size_t length = static_cast<size_t>(std::min<uint64_t>(view_page_size, file.size() - offset));
+
+            if ((parent->Read(buffer.data(), parent->GetStart() + offset, length) != length) ||
+                std::memcmp(buffer.data(), file.data() + offset, length))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Maps the file backing the raw parent view, if the view is known to still match it.
+    // The file can still be changed in place while it's mapped. Tools rebuilding a file usually replace it instead,
+    // which leaves the mapping as it was.
+    static std::shared_ptr<mapped_file> map_original_file(Ref<BinaryView> view)
+    {
+        Ref<BinaryView> parent = view->GetParentView();
+
+        if (!parent || parent->GetParentView() || (parent->GetTypeName() != "Raw"))
+        {
+            return nullptr;
+        }
+
+        Ref<FileMetadata> file = view->GetFile();
+
+        // Databases and unsaved patches can differ from the file on disk
+        if (file->IsModified() || (file->GetFilename() != file->GetOriginalFilename()))
+        {
+            return nullptr;
+        }
+
+        std::shared_ptr<mapped_file> result = std::make_shared<mapped_file>(file->GetOriginalFilename());
+
+        if (!*result || (result->size() != parent->GetLength()))
+        {
+            return nullptr;
+        }
+
+        if (!matches_raw_view(parent, *result))
+        {
+            BinjaLog(
+                InfoLog, "\"{}\" no longer matches the view, reading the view instead", file->GetOriginalFilename());
+
+            return nullptr;
+        }
+
+        return result;
+    }
+
+    std::vector<segment_layout> get_segment_layout(Ref<BinaryView> view)
+    {
+        std::vector<segment_layout> results;
+
+        std::vector<Ref<Segment>> view_segments = view->GetSegments();
+
+        if (!view_segments.empty())
+        {
+            results.reserve(view_segments.size());
+
+            for (const Ref<Segment>& segment : view_segments)
+            {
+                const uint64_t length = segment->GetLength();
+
+                // Anything past the end of the segment's data (e.g. .bss) reads as zero
+                results.push_back({segment->GetStart(), length, std::min(segment->GetDataLength(), length)});
+            }
+        }
+        else
+        {
+            results.push_back({view->GetStart(), view->GetLength(), view->GetLength()});
+        }
+
+        return results;
+    }
+
+    view_data::view_data(Ref<BinaryView> view)
     {
         std::vector<Ref<Segment>> view_segments = view->GetSegments();
 
         if (!view_segments.empty())
         {
+            file = map_original_file(view);
+
             segments.reserve(view_segments.size());
 
             for (const Ref<Segment>& segment : view_segments)
             {
-                segments.emplace_back(view, segment->GetStart(), segment->GetLength());
+                const uint64_t start = segment->GetStart();
+                const uint64_t length = segment->GetLength();
+                const uint64_t data_length = std::min(segment->GetDataLength(), length);
+                const uint64_t data_offset = segment->GetDataOffset();
+
+                // Relocated segments don't match the file, so they still need to be read
+                if (file && (segment->GetRelocationsCount() == 0) && (data_offset <= file->size()) &&
+                    (data_length <= file->size() - data_offset))
+                {
+                    segments.emplace_back(start, length, data_length, file->data() + data_offset);
+                }
+                else
+                {
+                    segments.emplace_back(view, start, length, data_length);
+                }
+            }
+        }
+        else
+        {
+            segments.emplace_back(view, view->GetStart(), view->GetLength(), view->GetLength());
+        }
+    }
+
+    view_data::view_data(std::shared_ptr<mapped_file> file_, std::vector<view_segment> segments_,
+        std::unique_ptr<byte_histogram> histogram)
+        : file(std::move(file_))
+        , segments(std::move(segments_))
+    {
+        if (histogram)
+        {
+            std::call_once(histogram_once_, [&] { histogram_ = std::move(histogram); });
+        }
+    }
+
+    view_data::view_data(Ref<BinaryView> view, const view_data& previous, std::vector<address_range> dirty)
+        : file(previous.file)
+    {
+        merge_ranges(dirty);
+
+        std::vector<segment_layout> layout = get_segment_layout(view);
+
+        segments.reserve(layout.size());
+
+        std::vector<address_range> segment_dirty;
+
+        for (const segment_layout& current : layout)
+        {
+            auto prev =
+                std::find_if(previous.segments.begin(), previous.segments.end(), [&](const view_segment& segment) {
+                    return (segment.start == current.start) && (segment.length == current.length) &&
+                        (segment.data_length == current.data_length);
+                });
+
+            // Segments which were added or resized can't reuse anything
+            if (prev == previous.segments.end())
+            {
+                segments.emplace_back(view, current.start, current.length, current.data_length);
+
+                continue;
+            }
+
+            segment_dirty.clear();
+
+            for (const address_range& page : dirty)
+            {
+                if ((page.start < current.start + current.data_length) && (page.end > current.start))
+                {
+                    segment_dirty.push_back(page);
+                }
+            }
+
+            if (segment_dirty.empty())
+            {
+                segments.push_back(*prev);
+            }
+            else
+            {
+                segments.emplace_back(view, *prev, segment_dirty);
+            }
+        }
+    }
+
+    std::vector<view_region> view_data::regions() const
+    {
+        std::vector<view_region> results;
+
+        results.reserve(segments.size());
+
+        for (const view_segment& segment : segments)
+        {
+            results.push_back({segment.start, segment.data, static_cast<size_t>(segment.data_length),
+                segment.length - segment.data_length});
+        }
+
+        return results;
+    }
+
+    std::vector<view_region> view_data::regions(const std::vector<address_range>& ranges) const
+    {
+        std::vector<view_region> results;
+
+        for (const view_segment& segment : segments)
+        {
+            const uint64_t segment_end = segment.start + segment.length;
+            const uint64_t data_end = segment.start + segment.data_length;
+
+            for (const address_range& range : ranges)
+            {
+                const uint64_t sub_start = std::max(range.start, segment.start);
+                const uint64_t sub_end = std::min(range.end, segment_end);
+
+                if (sub_start >= sub_end)
+                {
+                    continue;
+                }
+
+                if (sub_start < data_end)
+                {
+                    const uint64_t sub_data_end = std::min(sub_end, data_end);
+
+                    results.push_back({sub_start, segment.data + (sub_start - segment.start),
+                        static_cast<size_t>(sub_data_end - sub_start), sub_end - sub_data_end});
+                }
+                else
+                {
+                    results.push_back({sub_start, nullptr, 0, sub_end - sub_start});
+                }
+            }
+        }
+
+        return results;
+    }
+
+    bool view_data::read(uint64_t address, void* buffer, size_t length) const
+    {
+        // Segments are sorted by address
+        auto iter = std::upper_bound(segments.begin(), segments.end(), address,
+            [](uint64_t value, const view_segment& segment) { return value < segment.start; });
+
+        if (iter == segments.begin())
+        {
+            return false;
+        }
+
+        const view_segment& segment = *std::prev(iter);
+
+        const uint64_t offset = address - segment.start;
+
+        if ((offset > segment.length) || (length > segment.length - offset))
+        {
+            return false;
+        }
+
+        uint8_t* output = static_cast<uint8_t*>(buffer);
+
+        size_t data_length = 0;
+
+        if (offset < segment.data_length)
+        {
+            data_length = static_cast<size_t>(std::min<uint64_t>(length, segment.data_length - offset));
+
+            std::memcpy(output, segment.data + offset, data_length);
+        }
+
+        std::memset(output + data_length, 0, length - data_length);
+
+        return true;
+    }
+
+    const byte_histogram& view_data::histogram() const
+    {
+        std::call_once(histogram_once_, [this] {
+            std::unique_ptr<byte_histogram> result(new byte_histogram());
+            std::mutex result_lock;
+
+            for (const view_region& region : regions())
+            {
+                // Pairs spanning two chunks aren't counted, which is close enough
+                parallel_partition(region.length, parallel_scan_partition, 0, [&](size_t offset, size_t length) {
+                    byte_histogram sub_result;
+
+                    sub_result.add(region.data + offset, length);
+
+                    std::lock_guard<std::mutex> guard(result_lock);
+
+                    result->merge(sub_result);
+
+                    return true;
+                });
+
+                result->add_zeros(region.zero_length);
+            }
+
+            histogram_ = std::move(result);
+        });
+
+        return *histogram_;
+    }
+
+    uint64_t view_data::content_hash() const
+    {
+        std::call_once(content_hash_once_, [this] {
+            uint64_t result = 0;
+
+            for (const view_segment& segment : segments)
+            {
+                result = hash_bytes(&segment.start, sizeof(segment.start), result);
+                result = hash_bytes(&segment.length, sizeof(segment.length), result);
+
+                const size_t data_length = static_cast<size_t>(segment.data_length);
+
+                if (data_length == 0)
+                {
+                    continue;
+                }
+
+                // Hash each chunk separately, so the result doesn't depend on how they were split between threads
+                std::vector<uint64_t> chunk_hashes(
+                    (data_length + parallel_scan_partition - 1) / parallel_scan_partition);
+
+                parallel_partition(data_length, parallel_scan_partition, 0, [&](size_t offset, size_t length) {
+                    chunk_hashes[offset / parallel_scan_partition] = hash_bytes(segment.data + offset, length);
+
+                    return true;
+                });
+
+                result = hash_bytes(chunk_hashes.data(), chunk_hashes.size() * sizeof(uint64_t), result);
+            }
+
+            content_hash_ = result;
+        });
+
+        return content_hash_;
+    }
+
+    bool matches_zero(const mem::pattern& pattern)
+    {
+        const mem::byte* bytes = pattern.bytes();
+        const mem::byte* masks = pattern.masks();
+
+        for (size_t i = 0, size = pattern.size(); i < size; ++i)
+        {
+            if ((bytes[i] & masks[i]) != 0)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    static std::string trim(const std::string& text)
+    {
+        const size_t start = text.find_first_not_of(" \t");
+
+        if (start == std::string::npos)
+        {
+            return "";
+        }
+
+        return text.substr(start, text.find_last_not_of(" \t") - start + 1);
+    }
+
+    static bool parse_address(const std::string& text, uint64_t& out)
+    {
+        size_t i = 0;
+
+        if ((text.size() > 2) && (text[0] == '0') && ((text[1] == 'x') || (text[1] == 'X')))
+        {
+            i = 2;
+        }
+
+        if (i == text.size())
+        {
+            return false;
+        }
+
+        uint64_t value = 0;
+
+        for (; i < text.size(); ++i)
+        {
+            const int digit = mem::xctoi(text[i]);
+
+            if ((digit == -1) || (value > (UINT64_MAX >> 4)))
+            {
+                return false;
+            }
+
+            value = (value * 16) + digit;
+        }
+
+        out = value;
+
+        return true;
+    }
+
+    bool scan_scope::parse(const std::string& text)
+    {
+        size_t current = 0;
+
+        while (current <= text.size())
+        {
+            size_t next = text.find(',', current);
+
+            if (next == std::string::npos)
+            {
+                next = text.size();
+            }
+
+            const std::string term = trim(text.substr(current, next - current));
+
+            current = next + 1;
+
+            if (term.empty())
+            {
+                continue;
+            }
+
+            if ((term == "executable") || (term == "exec"))
+            {
+                executable = true;
+
+                continue;
+            }
+
+            const size_t dash = term.find('-');
+
+            if (dash != std::string::npos)
+            {
+                address_range range {};
+
+                if (parse_address(trim(term.substr(0, dash)), range.start) &&
+                    parse_address(trim(term.substr(dash + 1)), range.end))
+                {
+                    if (range.start >= range.end)
+                    {
+                        return false;
+                    }
+
+                    ranges.push_back(range);
+                    range_names.push_back(term);
+
+                    continue;
+                }
+            }
+
+            sections.push_back(term);
+        }
+
+        return true;
+    }
+
+    bool scan_scope::empty() const
+    {
+        return !executable && sections.empty() && ranges.empty();
+    }
+
+    std::vector<address_range> view_ranges(Ref<BinaryView> view)
+    {
+        std::vector<address_range> results;
+
+        std::vector<Ref<Segment>> view_segments = view->GetSegments();
+
+        if (!view_segments.empty())
+        {
+            for (const Ref<Segment>& segment : view_segments)
+            {
+                results.push_back({segment->GetStart(), segment->GetEnd()});
             }
         }
         else
         {
-            segments.emplace_back(view, view->GetStart(), view->GetLength());
+            results.push_back({view->GetStart(), view->GetStart() + view->GetLength()});
+        }
+
+        merge_ranges(results);
+
+        return results;
+    }
+
+    std::vector<address_range> scan_scope::resolve(Ref<BinaryView> view) const
+    {
+        std::vector<address_range> mapped = view_ranges(view);
+
+        if (empty())
+        {
+            return mapped;
+        }
+
+        std::vector<address_range> results;
+
+        for (size_t i = 0; i < ranges.size(); ++i)
+        {
+            Ref<Section> section = (i < range_names.size()) ? view->GetSectionByName(range_names[i]) : nullptr;
+
+            results.push_back(section ? address_range {section->GetStart(), section->GetEnd()} : ranges[i]);
+        }
+
+        if (executable)
+        {
+            for (const Ref<Segment>& segment : view->GetSegments())
+            {
+                if (segment->GetFlags() & SegmentExecutable)
+                {
+                    results.push_back({segment->GetStart(), segment->GetEnd()});
+                }
+            }
+        }
+
+        for (const std::string& name : sections)
+        {
+            Ref<Section> section = view->GetSectionByName(name);
+
+            if (section)
+            {
+                results.push_back({section->GetStart(), section->GetEnd()});
+            }
+            else
+            {
+                BinjaLog(WarningLog, "Unknown section \"{}\"", name);
+            }
         }
+
+        merge_ranges(results);
+
+        // Don't include anything outside of the view's segments
+        std::vector<address_range> clipped;
+
+        for (const address_range& range : results)
+        {
+            for (const address_range& bounds : mapped)
+            {
+                const uint64_t sub_start = std::max(range.start, bounds.start);
+                const uint64_t sub_end = std::min(range.end, bounds.end);
+
+                if (sub_start < sub_end)
+                {
+                    clipped.push_back({sub_start, sub_end});
+                }
+            }
+        }
+
+        return clipped;
     }
 } // namespace brick
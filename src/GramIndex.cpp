@@ -0,0 +1,324 @@
+/*
+    Copyright 2018 Brick
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+    and associated documentation files (the "Software"), to deal in the Software without restriction,
+    including without limitation the rights to use, copy, modify, merge, publish, distribute,
+    sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all copies or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+    BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "GramIndex.h"
+
+namespace brick
+{
+    constexpr const size_t gram_size = 4;
+    constexpr const unsigned gram_bucket_bits = 16;
+    constexpr const size_t gram_bucket_count = size_t(1) << gram_bucket_bits;
+
+    // Secondary grams checked before verifying a candidate
+    constexpr const size_t max_secondary_grams = 3;
+
+    static inline uint32_t gram_bucket(const uint8_t* data)
+    {
+        uint32_t gram;
+        std::memcpy(&gram, data, sizeof(gram));
+
+        return (gram * UINT32_C(0x9E3779B1)) >> (32 - gram_bucket_bits);
+    }
+
+    gram_index::gram_index(std::shared_ptr<const view_data> data)
+        : data_(std::move(data))
+        , regions_(data_->regions())
+        , counts_(gram_bucket_count, 0)
+    {
+        for (size_t i = 0; i < regions_.size(); ++i)
+        {
+            const size_t length = regions_[i].length;
+
+            for (size_t offset = 0; offset < length; offset += parallel_scan_partition)
+            {
+                chunks_.push_back({i, offset, std::min(parallel_scan_partition, length - offset), {}, {}});
+            }
+        }
+
+        parallel_for_each(chunks_.begin(), chunks_.end(), [this](index_chunk& chunk) {
+            build_chunk(chunk);
+
+            return true;
+        });
+
+        for (const index_chunk& chunk : chunks_)
+        {
+            for (size_t i = 0; i < gram_bucket_count; ++i)
+            {
+                counts_[i] += chunk.buckets[i + 1] - chunk.buckets[i];
+            }
+        }
+    }
+
+    void gram_index::build_chunk(index_chunk& chunk) const
+    {
+        const view_region& region = regions_[chunk.region];
+
+        // Grams may read past the end of the chunk, but not past the end of the region
+        const size_t gram_end = (region.length >= gram_size) ? (region.length - gram_size + 1) : 0;
+        const size_t end = std::min(chunk.offset + chunk.length, gram_end);
+        const size_t count = (end > chunk.offset) ? (end - chunk.offset) : 0;
+
+        // Counting sort the positions by bucket, which keeps each bucket in ascending order
+        std::vector<uint32_t> starts(gram_bucket_count + 1, 0);
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            ++starts[gram_bucket(region.data + chunk.offset + i) + 1];
+        }
+
+        for (size_t i = 0; i < gram_bucket_count; ++i)
+        {
+            starts[i + 1] += starts[i];
+        }
+
+        std::vector<uint32_t> sorted(count);
+        std::vector<uint32_t> next(starts.begin(), starts.end() - 1);
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            sorted[next[gram_bucket(region.data + chunk.offset + i)]++] = static_cast<uint32_t>(i);
+        }
+
+        chunk.buckets.assign(gram_bucket_count + 1, 0);
+        chunk.postings.clear();
+        chunk.postings.reserve(count * 2);
+
+        for (size_t i = 0; i < gram_bucket_count; ++i)
+        {
+            chunk.buckets[i] = static_cast<uint32_t>(chunk.postings.size());
+
+            uint32_t previous = 0;
+
+            for (uint32_t j = starts[i]; j != starts[i + 1]; ++j)
+            {
+                uint32_t delta = sorted[j] - previous;
+                previous = sorted[j];
+
+                while (delta >= 0x80)
+                {
+                    chunk.postings.push_back(static_cast<uint8_t>(delta | 0x80));
+                    delta >>= 7;
+                }
+
+                chunk.postings.push_back(static_cast<uint8_t>(delta));
+            }
+        }
+
+        chunk.buckets[gram_bucket_count] = static_cast<uint32_t>(chunk.postings.size());
+        chunk.postings.shrink_to_fit();
+    }
+
+    void gram_index::decode(const index_chunk& chunk, uint32_t bucket, std::vector<size_t>& positions) const
+    {
+        positions.clear();
+
+        const uint8_t* current = chunk.postings.data() + chunk.buckets[bucket];
+        const uint8_t* const end = chunk.postings.data() + chunk.buckets[bucket + 1];
+
+        uint32_t position = 0;
+
+        while (current != end)
+        {
+            uint32_t delta = 0;
+
+            for (unsigned shift = 0;; shift += 7)
+            {
+                const uint8_t value = *current++;
+
+                delta |= uint32_t(value & 0x7F) << shift;
+
+                if (!(value & 0x80))
+                {
+                    break;
+                }
+            }
+
+            position += delta;
+            positions.push_back(chunk.offset + position);
+        }
+    }
+
+    size_t gram_index::size_in_bytes() const
+    {
+        size_t result = 0;
+
+        for (const index_chunk& chunk : chunks_)
+        {
+            result += chunk.postings.size() + chunk.buckets.size() * sizeof(uint32_t);
+        }
+
+        return result;
+    }
+
+    bool gram_index::scan_all(const std::vector<view_region>& regions, const mem::pattern& pattern,
+        const simd_scanner& scanner, std::vector<uint64_t>& results, bool parallel) const
+    {
+        struct gram_query
+        {
+            size_t offset;
+            uint32_t bucket;
+        };
+
+        const size_t size = pattern.size();
+        const uint8_t* bytes = scanner.bytes();
+
+        std::vector<gram_query> grams;
+
+        for (size_t i = 0, run = 0; i < size; ++i)
+        {
+            run = (pattern.masks()[i] == 0xFF) ? (run + 1) : 0;
+
+            if (run >= gram_size)
+            {
+                grams.push_back({i + 1 - gram_size, gram_bucket(bytes + i + 1 - gram_size)});
+            }
+        }
+
+        if (grams.empty())
+        {
+            return false;
+        }
+
+        // Look up the least common gram, and filter its positions with the next least common ones
+        std::sort(grams.begin(), grams.end(), [this](const gram_query& lhs, const gram_query& rhs) {
+            return counts_[lhs.bucket] < counts_[rhs.bucket];
+        });
+
+        if (grams.size() > max_secondary_grams + 1)
+        {
+            grams.resize(max_secondary_grams + 1);
+        }
+
+        // Matches must lie inside the data of one of the requested regions
+        std::vector<address_range> bounds;
+
+        for (const view_region& region : regions)
+        {
+            if (region.length >= size)
+            {
+                bounds.push_back({region.start, region.start + region.length});
+            }
+        }
+
+        std::sort(bounds.begin(), bounds.end(),
+            [](const address_range& lhs, const address_range& rhs) { return lhs.start < rhs.start; });
+
+        const auto in_bounds = [&](uint64_t start) {
+            auto iter = std::upper_bound(bounds.begin(), bounds.end(), start,
+                [](uint64_t value, const address_range& range) { return value < range.start; });
+
+            return (iter != bounds.begin()) && (start + size <= std::prev(iter)->end);
+        };
+
+        std::mutex results_lock;
+
+        if (!bounds.empty())
+        {
+            const auto scan_chunk = [&](const index_chunk& chunk) {
+                const view_region& region = regions_[chunk.region];
+
+                std::vector<size_t> primary;
+                std::vector<std::vector<size_t>> secondary(grams.size() - 1);
+
+                decode(chunk, grams[0].bucket, primary);
+
+                if (primary.empty())
+                {
+                    return true;
+                }
+
+                for (size_t i = 1; i < grams.size(); ++i)
+                {
+                    decode(chunk, grams[i].bucket, secondary[i - 1]);
+                }
+
+                std::vector<uint64_t> sub_results;
+
+                for (size_t position : primary)
+                {
+                    if (position < grams[0].offset)
+                    {
+                        continue;
+                    }
+
+                    const size_t start = position - grams[0].offset;
+
+                    if (start + size > region.length)
+                    {
+                        continue;
+                    }
+
+                    bool candidate = true;
+
+                    for (size_t i = 1; candidate && (i < grams.size()); ++i)
+                    {
+                        const size_t other = start + grams[i].offset;
+
+                        // Grams in other chunks aren't checked here, verify catches them instead
+                        if ((other >= chunk.offset) && (other < chunk.offset + chunk.length))
+                        {
+                            candidate = std::binary_search(secondary[i - 1].begin(), secondary[i - 1].end(), other);
+                        }
+                    }
+
+                    if (candidate && scanner.verify(region.data + start) && in_bounds(region.start + start))
+                    {
+                        sub_results.push_back(region.start + start);
+                    }
+                }
+
+                if (!sub_results.empty())
+                {
+                    std::lock_guard<std::mutex> guard(results_lock);
+
+                    results.insert(results.end(), sub_results.begin(), sub_results.end());
+                }
+
+                return true;
+            };
+
+            if (parallel)
+            {
+                parallel_for_each(chunks_.begin(), chunks_.end(), scan_chunk);
+            }
+            else
+            {
+                for (const index_chunk& chunk : chunks_)
+                {
+                    scan_chunk(chunk);
+                }
+            }
+        }
+
+        // Zero runs aren't indexed
+        for (const view_region& region : regions)
+        {
+            view_data::scan_zero_run(region, pattern, scanner, [&](uint64_t addr) {
+                results.push_back(addr);
+
+                return false;
+            });
+        }
+
+        std::sort(results.begin(), results.end());
+
+        return true;
+    }
+} // namespace brick
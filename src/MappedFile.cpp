@@ -0,0 +1,146 @@
+/*
+    Copyright 2018 Brick
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+    and associated documentation files (the "Software"), to deal in the Software without restriction,
+    including without limitation the rights to use, copy, modify, merge, publish, distribute,
+    sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all copies or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+    BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "MappedFile.h"
+
+#include <limits>
+#include <vector>
+
+#if defined(_WIN32)
+#    define WIN32_LEAN_AND_MEAN
+#    include <Windows.h>
+#else
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#endif
+
+namespace brick
+{
+#if defined(_WIN32)
+    mapped_file::mapped_file(const std::string& path)
+    {
+        int wide_length = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, nullptr, 0);
+
+        if (wide_length <= 0)
+        {
+            return;
+        }
+
+        std::vector<wchar_t> wide_path(wide_length);
+
+        MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, wide_path.data(), wide_length);
+
+        // Don't stop anything else from rebuilding or removing the file while it's mapped
+        const DWORD share_mode = FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE;
+
+        HANDLE file = CreateFileW(
+            wide_path.data(), GENERIC_READ, share_mode, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            return;
+        }
+
+        file_ = file;
+
+        LARGE_INTEGER file_size;
+
+        if (!GetFileSizeEx(file, &file_size) || (file_size.QuadPart == 0) ||
+            (static_cast<uint64_t>(file_size.QuadPart) > std::numeric_limits<size_t>::max()))
+        {
+            return;
+        }
+
+        HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+        if (!mapping)
+        {
+            return;
+        }
+
+        mapping_ = mapping;
+
+        void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+
+        if (!view)
+        {
+            return;
+        }
+
+        data_ = static_cast<const uint8_t*>(view);
+        size_ = static_cast<size_t>(file_size.QuadPart);
+    }
+
+    mapped_file::~mapped_file()
+    {
+        if (data_)
+        {
+            UnmapViewOfFile(data_);
+        }
+
+        if (mapping_)
+        {
+            CloseHandle(mapping_);
+        }
+
+        if (file_)
+        {
+            CloseHandle(file_);
+        }
+    }
+#else
+    mapped_file::mapped_file(const std::string& path)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+
+        if (fd == -1)
+        {
+            return;
+        }
+
+        struct stat file_stat;
+
+        if ((fstat(fd, &file_stat) == 0) && (file_stat.st_size > 0) &&
+            (static_cast<uint64_t>(file_stat.st_size) <= std::numeric_limits<size_t>::max()))
+        {
+            size_t file_size = static_cast<size_t>(file_stat.st_size);
+
+            void* view = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (view != MAP_FAILED)
+            {
+                data_ = static_cast<const uint8_t*>(view);
+                size_ = file_size;
+            }
+        }
+
+        close(fd);
+    }
+
+    mapped_file::~mapped_file()
+    {
+        if (data_)
+        {
+            munmap(const_cast<uint8_t*>(data_), size_);
+        }
+    }
+#endif
+} // namespace brick
@@ -0,0 +1,317 @@
+/*
+    Copyright 2018 Brick
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+    and associated documentation files (the "Software"), to deal in the Software without restriction,
+    including without limitation the rights to use, copy, modify, merge, publish, distribute,
+    sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all copies or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+    BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "MultiScanner.h"
+#include "ViewStream.h"
+
+namespace brick
+{
+    static inline uint32_t load_gram4(const uint8_t* data)
+    {
+        uint32_t result;
+        std::memcpy(&result, data, sizeof(result));
+        return result;
+    }
+
+    static inline uint16_t load_gram2(const uint8_t* data)
+    {
+        uint16_t result;
+        std::memcpy(&result, data, sizeof(result));
+        return result;
+    }
+
+    // Finds the run of width fully known bytes least likely to occur in the data
+    static bool find_anchor(const mem::pattern& pattern, size_t width, const byte_histogram& histogram, size_t& offset)
+    {
+        const mem::byte* bytes = pattern.bytes();
+        const mem::byte* masks = pattern.masks();
+        const size_t size = pattern.size();
+
+        bool found = false;
+        uint64_t best_count = 0;
+        size_t run = 0;
+
+        for (size_t i = 0; i < size; ++i)
+        {
+            run = (masks[i] == 0xFF) ? (run + 1) : 0;
+
+            if (run < width)
+            {
+                continue;
+            }
+
+            // A run can't occur more often than any of the pairs in it
+            uint64_t count = UINT64_MAX;
+
+            for (size_t j = i + 1 - width; j < i; ++j)
+            {
+                count = std::min(count, histogram.pair(bytes[j], bytes[j + 1]));
+            }
+
+            if (!found || (count < best_count))
+            {
+                found = true;
+                best_count = count;
+                offset = i + 1 - width;
+            }
+        }
+
+        return found;
+    }
+
+    multi_scanner::multi_scanner(std::vector<mem::pattern> patterns, const byte_histogram* histogram)
+        : patterns_(std::move(patterns))
+    {
+        if (!histogram)
+        {
+            histogram = &typical_byte_histogram();
+        }
+
+        scanners_.reserve(patterns_.size());
+
+        for (uint32_t i = 0; i < patterns_.size(); ++i)
+        {
+            const mem::pattern& pattern = patterns_[i];
+
+            scanners_.emplace_back(pattern, histogram);
+
+            max_size_ = std::max(max_size_, pattern.size());
+
+            const uint8_t* bytes = scanners_.back().bytes();
+
+            size_t offset = 0;
+
+            if (find_anchor(pattern, 4, *histogram, offset))
+            {
+                gram4_entries_.push_back({load_gram4(bytes + offset), i, static_cast<uint32_t>(offset)});
+            }
+            else if (find_anchor(pattern, 2, *histogram, offset))
+            {
+                gram2_entries_.push_back({load_gram2(bytes + offset), i, static_cast<uint32_t>(offset)});
+            }
+            else if (pattern.size() != 0)
+            {
+                unanchored_.push_back(i);
+            }
+        }
+
+        if (!gram4_entries_.empty())
+        {
+            unsigned bits = 10;
+
+            while (((size_t(1) << bits) < gram4_entries_.size() * 2) && (bits < 24))
+            {
+                ++bits;
+            }
+
+            gram4_shift_ = 32 - bits;
+
+            const auto bucket_of = [this](uint32_t gram) { return (gram * UINT32_C(0x9E3779B1)) >> gram4_shift_; };
+
+            std::sort(gram4_entries_.begin(), gram4_entries_.end(),
+                [&](const anchor_entry& lhs, const anchor_entry& rhs) {
+                    return bucket_of(lhs.gram) < bucket_of(rhs.gram);
+                });
+
+            gram4_offsets_.assign((size_t(1) << bits) + 1, 0);
+            gram4_filter_.assign(0x10000 / 64, 0);
+
+            for (const anchor_entry& entry : gram4_entries_)
+            {
+                ++gram4_offsets_[bucket_of(entry.gram) + 1];
+
+                const uint16_t prefix = static_cast<uint16_t>(entry.gram);
+
+                gram4_filter_[prefix / 64] |= uint64_t(1) << (prefix % 64);
+            }
+
+            for (size_t i = 1; i < gram4_offsets_.size(); ++i)
+            {
+                gram4_offsets_[i] += gram4_offsets_[i - 1];
+            }
+        }
+
+        if (!gram2_entries_.empty())
+        {
+            std::sort(gram2_entries_.begin(), gram2_entries_.end(),
+                [](const anchor_entry& lhs, const anchor_entry& rhs) { return lhs.gram < rhs.gram; });
+
+            gram2_offsets_.assign(0x10000 + 1, 0);
+
+            for (const anchor_entry& entry : gram2_entries_)
+            {
+                ++gram2_offsets_[entry.gram + 1];
+            }
+
+            for (size_t i = 1; i < gram2_offsets_.size(); ++i)
+            {
+                gram2_offsets_[i] += gram2_offsets_[i - 1];
+            }
+        }
+    }
+
+    void multi_scanner::scan_chunk(const view_region& region, size_t begin, size_t end, size_t own_end, size_t skip,
+        std::vector<std::pair<uint32_t, uint64_t>>& results) const
+    {
+        const uint8_t* data = region.data;
+
+        const auto check = [&](const anchor_entry& entry, size_t pos) {
+            if (pos < begin + entry.offset)
+            {
+                return;
+            }
+
+            const size_t start = pos - entry.offset;
+            const size_t size = patterns_[entry.pattern].size();
+
+            if ((start < own_end) && (size <= end - start) && (start + size > skip) &&
+                scanners_[entry.pattern].verify(data + start))
+            {
+                results.emplace_back(entry.pattern, region.start + start);
+            }
+        };
+
+        const bool has_gram4 = !gram4_entries_.empty();
+        const bool has_gram2 = !gram2_entries_.empty();
+
+        if (has_gram4 || has_gram2)
+        {
+            for (size_t pos = begin; pos + 2 <= end; ++pos)
+            {
+                if (has_gram4 && (pos + 4 <= end))
+                {
+                    const uint32_t gram = load_gram4(data + pos);
+                    const uint16_t prefix = static_cast<uint16_t>(gram);
+
+                    if (gram4_filter_[prefix / 64] & (uint64_t(1) << (prefix % 64)))
+                    {
+                        const uint32_t bucket = (gram * UINT32_C(0x9E3779B1)) >> gram4_shift_;
+
+                        for (uint32_t i = gram4_offsets_[bucket], i_end = gram4_offsets_[bucket + 1]; i != i_end; ++i)
+                        {
+                            if (gram4_entries_[i].gram == gram)
+                            {
+                                check(gram4_entries_[i], pos);
+                            }
+                        }
+                    }
+                }
+
+                if (has_gram2)
+                {
+                    const uint16_t gram = load_gram2(data + pos);
+
+                    for (uint32_t i = gram2_offsets_[gram], i_end = gram2_offsets_[gram + 1]; i != i_end; ++i)
+                    {
+                        check(gram2_entries_[i], pos);
+                    }
+                }
+            }
+        }
+
+        for (uint32_t index : unanchored_)
+        {
+            const size_t size = patterns_[index].size();
+
+            scanners_[index](mem::region {data + begin, end - begin}, [&](mem::pointer result) {
+                const size_t start = static_cast<size_t>(result.as<const uint8_t*>() - data);
+
+                if ((start < own_end) && (start + size > skip))
+                {
+                    results.emplace_back(index, region.start + start);
+                }
+
+                return false;
+            });
+        }
+    }
+
+    std::vector<std::vector<uint64_t>> multi_scanner::collect(
+        std::vector<std::pair<uint32_t, uint64_t>>& matches) const
+    {
+        std::sort(matches.begin(), matches.end());
+
+        std::vector<std::vector<uint64_t>> results(patterns_.size());
+
+        for (const auto& match : matches)
+        {
+            results[match.first].push_back(match.second);
+        }
+
+        return results;
+    }
+
+    std::vector<std::vector<uint64_t>> multi_scanner::scan_all(const std::vector<view_region>& regions) const
+    {
+        std::vector<std::pair<uint32_t, uint64_t>> matches;
+        std::mutex matches_lock;
+
+        const size_t overlap = (max_size_ != 0) ? (max_size_ - 1) : 0;
+
+        for (const view_region& region : regions)
+        {
+            parallel_partition(region.length, parallel_scan_partition, overlap, [&](size_t offset, size_t length) {
+                std::vector<std::pair<uint32_t, uint64_t>> sub_matches;
+
+                scan_chunk(region, offset, offset + length, offset + parallel_scan_partition, 0, sub_matches);
+
+                if (!sub_matches.empty())
+                {
+                    std::lock_guard<std::mutex> guard(matches_lock);
+
+                    matches.insert(matches.end(), sub_matches.begin(), sub_matches.end());
+                }
+
+                return true;
+            });
+
+            if (region.zero_length != 0)
+            {
+                for (uint32_t i = 0; i < patterns_.size(); ++i)
+                {
+                    view_data::scan_zero_run(region, patterns_[i], scanners_[i], [&](uint64_t addr) {
+                        matches.emplace_back(i, addr);
+
+                        return false;
+                    });
+                }
+            }
+        }
+
+        return collect(matches);
+    }
+
+    std::vector<std::vector<uint64_t>> multi_scanner::stream_scan_all(
+        Ref<BinaryView> view, const std::vector<address_range>& ranges) const
+    {
+        std::vector<std::pair<uint32_t, uint64_t>> matches;
+
+        const size_t overlap = (max_size_ != 0) ? (max_size_ - 1) : 0;
+
+        // Matches entirely inside the carried over bytes were already found in the previous chunk
+        stream_view(view, ranges, static_cast<size_t>(get_scan_memory_limit(view) / 2), overlap,
+            [&](const view_region& region, size_t carry_length) {
+                scan_chunk(region, 0, region.length, region.length, carry_length, matches);
+
+                return true;
+            });
+
+        return collect(matches);
+    }
+} // namespace brick
@@ -0,0 +1,384 @@
+/*
+    Copyright 2018 Brick
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+    and associated documentation files (the "Software"), to deal in the Software without restriction,
+    including without limitation the rights to use, copy, modify, merge, publish, distribute,
+    sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all copies or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+    BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "PatternFileCache.h"
+#include "BinaryNinja.h"
+
+#include <filesystem>
+#include <fstream>
+
+namespace brick
+{
+    // "BNPATPFC"
+    constexpr const uint64_t pattern_cache_magic = 0x4346505441504E42;
+
+    // Increment whenever the layout of the file, or the compiled form of patterns or ops changes
+    constexpr const uint32_t pattern_cache_version = 2;
+
+    struct pattern_cache_header
+    {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t pattern_count;
+
+        // Hash of the pattern file's contents, and its modification time when it was compiled
+        uint64_t hash;
+        int64_t modified;
+
+        uint64_t file_size;
+    };
+
+    // Appends fields to a buffer, which is written out in one go
+    class cache_writer
+    {
+    public:
+        std::vector<uint8_t> buffer;
+
+        void write(const void* data, size_t length)
+        {
+            const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+            buffer.insert(buffer.end(), bytes, bytes + length);
+        }
+
+        void write_u64(uint64_t value)
+        {
+            write(&value, sizeof(value));
+        }
+
+        void write_string(const std::string& value)
+        {
+            write_u64(value.size());
+            write(value.data(), value.size());
+        }
+
+        void write_bytes(const std::vector<uint8_t>& value)
+        {
+            write_u64(value.size());
+            write(value.data(), value.size());
+        }
+
+        void write_strings(const std::vector<std::string>& values)
+        {
+            write_u64(values.size());
+
+            for (const std::string& value : values)
+            {
+                write_string(value);
+            }
+        }
+    };
+
+    // Reads fields back out of a mapped file. Any read past the end fails, and leaves the reader failed.
+    class cache_reader
+    {
+    private:
+        const uint8_t* data_;
+        size_t size_;
+        size_t offset_ {0};
+        bool failed_ {false};
+
+    public:
+        cache_reader(const uint8_t* data, size_t size, size_t offset)
+            : data_(data)
+            , size_(size)
+            , offset_(offset)
+        {}
+
+        bool read(void* buffer, size_t length)
+        {
+            if (failed_ || (offset_ > size_) || (length > size_ - offset_))
+            {
+                failed_ = true;
+
+                return false;
+            }
+
+            std::memcpy(buffer, data_ + offset_, length);
+            offset_ += length;
+
+            return true;
+        }
+
+        uint64_t read_u64()
+        {
+            uint64_t value = 0;
+            read(&value, sizeof(value));
+
+            return value;
+        }
+
+        // Reads the length of an array of elements of element_size bytes, failing if they can't all be there
+        size_t read_length(size_t element_size)
+        {
+            const uint64_t length = read_u64();
+
+            if (failed_ || (length > (size_ - offset_) / element_size))
+            {
+                failed_ = true;
+
+                return 0;
+            }
+
+            return static_cast<size_t>(length);
+        }
+
+        std::string read_string()
+        {
+            std::string value(read_length(1), '\0');
+            read(&value[0], value.size());
+
+            return value;
+        }
+
+        std::vector<uint8_t> read_bytes()
+        {
+            std::vector<uint8_t> value(read_length(1));
+            read(value.data(), value.size());
+
+            return value;
+        }
+
+        std::vector<std::string> read_strings()
+        {
+            // Every string is at least its length
+            std::vector<std::string> values(read_length(sizeof(uint64_t)));
+
+            for (std::string& value : values)
+            {
+                value = read_string();
+            }
+
+            return values;
+        }
+
+        bool failed() const
+        {
+            return failed_;
+        }
+    };
+
+    static std::filesystem::path get_cache_path(const std::filesystem::path& file_path)
+    {
+        std::error_code error;
+
+        const std::string canonical = std::filesystem::weakly_canonical(file_path, error).u8string();
+
+        return std::filesystem::u8path(GetUserDirectory()) / "pattern-cache" /
+            fmt::format("{:016X}.patterns", hash_bytes(canonical.data(), canonical.size()));
+    }
+
+    static bool get_modified_time(const std::filesystem::path& file_path, int64_t& modified)
+    {
+        std::error_code error;
+
+        const auto time = std::filesystem::last_write_time(file_path, error);
+
+        if (error)
+        {
+            return false;
+        }
+
+        modified = static_cast<int64_t>(time.time_since_epoch().count());
+
+        return true;
+    }
+
+    bool is_pattern_cache_enabled()
+    {
+        return Settings::Instance()->Get<bool>("pattern.cachePatternFiles");
+    }
+
+    bool load_pattern_cache(const std::string& file_name, uint64_t hash, compiled_pattern_file& compiled)
+    {
+        const std::filesystem::path file_path = std::filesystem::u8path(file_name);
+        const std::filesystem::path path = get_cache_path(file_path);
+
+        int64_t modified = 0;
+        std::error_code error;
+
+        if (!get_modified_time(file_path, modified) || !std::filesystem::exists(path, error))
+        {
+            return false;
+        }
+
+        mapped_file file(path.u8string());
+
+        if (!file || (file.size() < sizeof(pattern_cache_header)))
+        {
+            return false;
+        }
+
+        pattern_cache_header header;
+        std::memcpy(&header, file.data(), sizeof(header));
+
+        if ((header.magic != pattern_cache_magic) || (header.version != pattern_cache_version) ||
+            (header.file_size != file.size()))
+        {
+            BinjaLog(WarningLog, "Ignoring invalid pattern cache \"{}\"", path.u8string());
+
+            return false;
+        }
+
+        // The pattern file has changed since it was compiled
+        if ((header.hash != hash) || (header.modified != modified))
+        {
+            return false;
+        }
+
+        // Each pattern has at least 15 fields
+        if (header.pattern_count > (file.size() - sizeof(header)) / (15 * sizeof(uint64_t)))
+        {
+            BinjaLog(WarningLog, "Ignoring corrupt pattern cache \"{}\"", path.u8string());
+
+            return false;
+        }
+
+        cache_reader reader(file.data(), file.size(), sizeof(header));
+
+        compiled.hash = header.hash;
+        compiled.scope = reader.read_strings();
+        compiled.patterns.resize(header.pattern_count);
+
+        for (compiled_pattern& pattern : compiled.patterns)
+        {
+            pattern.name = reader.read_string();
+            pattern.type = reader.read_string();
+            pattern.pattern_string = reader.read_string();
+
+            pattern.has_ops = reader.read_u64() != 0;
+            pattern.ops_string = reader.read_string();
+
+            pattern.has_scope = reader.read_u64() != 0;
+            pattern.scope = reader.read_strings();
+
+            pattern.count = reader.read_u64();
+            pattern.index = reader.read_u64();
+
+            pattern.errors = reader.read_strings();
+
+            pattern.bytes = reader.read_bytes();
+            pattern.masks = reader.read_bytes();
+
+            pattern.code.resize(reader.read_length(sizeof(uint64_t)));
+            reader.read(pattern.code.data(), pattern.code.size() * sizeof(uint64_t));
+            pattern.stack_size = reader.read_u64();
+            pattern.references = reader.read_strings();
+
+            if (reader.failed() || (pattern.bytes.size() != pattern.masks.size()))
+            {
+                BinjaLog(WarningLog, "Ignoring corrupt pattern cache \"{}\"", path.u8string());
+
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool save_pattern_cache(const std::string& file_name, const compiled_pattern_file& compiled)
+    {
+        const std::filesystem::path file_path = std::filesystem::u8path(file_name);
+        const std::filesystem::path path = get_cache_path(file_path);
+
+        pattern_cache_header header {};
+
+        header.magic = pattern_cache_magic;
+        header.version = pattern_cache_version;
+        header.pattern_count = static_cast<uint32_t>(compiled.patterns.size());
+        header.hash = compiled.hash;
+
+        if (!get_modified_time(file_path, header.modified))
+        {
+            return false;
+        }
+
+        cache_writer writer;
+
+        writer.write(&header, sizeof(header));
+        writer.write_strings(compiled.scope);
+
+        for (const compiled_pattern& pattern : compiled.patterns)
+        {
+            writer.write_string(pattern.name);
+            writer.write_string(pattern.type);
+            writer.write_string(pattern.pattern_string);
+
+            writer.write_u64(pattern.has_ops);
+            writer.write_string(pattern.ops_string);
+
+            writer.write_u64(pattern.has_scope);
+            writer.write_strings(pattern.scope);
+
+            writer.write_u64(pattern.count);
+            writer.write_u64(pattern.index);
+
+            writer.write_strings(pattern.errors);
+
+            writer.write_bytes(pattern.bytes);
+            writer.write_bytes(pattern.masks);
+
+            writer.write_u64(pattern.code.size());
+            writer.write(pattern.code.data(), pattern.code.size() * sizeof(uint64_t));
+            writer.write_u64(pattern.stack_size);
+            writer.write_strings(pattern.references);
+        }
+
+        header.file_size = writer.buffer.size();
+        std::memcpy(writer.buffer.data(), &header, sizeof(header));
+
+        std::error_code error;
+
+        std::filesystem::create_directories(path.parent_path(), error);
+
+        // Write to a temporary file first, so a cache is never seen half written
+        std::filesystem::path temp_path = path;
+        temp_path += ".tmp";
+
+        {
+            std::ofstream output(temp_path, std::ios::binary | std::ios::trunc);
+
+            output.write(reinterpret_cast<const char*>(writer.buffer.data()),
+                static_cast<std::streamsize>(writer.buffer.size()));
+
+            if (!output)
+            {
+                BinjaLog(ErrorLog, "Failed to write pattern cache \"{}\"", temp_path.u8string());
+
+                output.close();
+                std::filesystem::remove(temp_path, error);
+
+                return false;
+            }
+        }
+
+        std::filesystem::rename(temp_path, path, error);
+
+        if (error)
+        {
+            BinjaLog(ErrorLog, "Failed to replace pattern cache \"{}\": {}", path.u8string(), error.message());
+
+            std::filesystem::remove(temp_path, error);
+
+            return false;
+        }
+
+        return true;
+    }
+} // namespace brick
@@ -19,8 +19,18 @@
 
 #include "PatternLoader.h"
 #include "BackgroundTaskThread.h"
-
+#include "MultiScanner.h"
+#include "PatternFileCache.h"
+#include "ViewCache.h"
+#include "ViewStream.h"
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
 #include <fstream>
+#include <iterator>
+#include <set>
+#include <unordered_map>
 #include <unordered_set>
 
 #include <mem/pattern.h>
@@ -61,6 +71,9 @@ namespace mem
         enum symbol : size_t
         {
             sym_here,
+
+            // The result of another pattern, sym_named + i for the i-th name referenced by the code
+            sym_named,
         };
 
         enum paren_type : size_t
@@ -69,17 +82,31 @@ namespace mem
             paren_bracket,
         };
 
-        struct environment
+        // Any names referenced with $name or ${name} are added to names, or fail to compile if it's null.
+        // If a reference can't be parsed, error describes why.
+        bool compile_infix(const char* string, std::vector<size_t>& code, std::vector<std::string>* names = nullptr,
+            std::string* error = nullptr);
+        bool compile_postfix(const char* string, std::vector<size_t>& code, std::vector<std::string>* names = nullptr,
+            std::string* error = nullptr);
+
+        // Code which has been checked once, so it can be run without any checks
+        struct program
         {
-            std::function<bool(size_t addr, size_t size, size_t& out)> read_integer;
-            std::function<bool(size_t sym, size_t& out)> resolve_symbol;
+            std::vector<size_t> code;
+
+            // Deepest the stack gets while running the code
+            size_t stack_size {0};
         };
 
-        bool compile_infix(const char* string, std::vector<size_t>& code);
-        bool compile_postfix(const char* string, std::vector<size_t>& code);
+        // Validates every operand and stack access, and folds operations on constants.
+        // Fails unless the code always leaves exactly one value on the stack.
+        bool compile_program(const std::vector<size_t>& input, program& output);
 
-        bool execute(
-            const std::vector<size_t>& input, size_t* stack, size_t stack_size, size_t& sp_out, const environment& env);
+        // Runs a compiled program, with $here set to here. The stack must hold at least prog.stack_size values.
+        // env must provide bool read_integer(size_t addr, size_t size, size_t& out), reading size bytes (or a pointer,
+        // if size is 0), and bool resolve_symbol(size_t sym, size_t& out) for each sym_named + i.
+        template <typename Environment>
+        bool run(const program& prog, size_t here, size_t* stack, size_t& out, Environment& env);
 
         struct token
         {
@@ -176,7 +203,83 @@ namespace mem
             return false;
         }
 
-        bool compile_infix(const char* string, std::vector<size_t>& code)
+        // "$" and "$here" are the address being evaluated, anything else is a name looked up in names.
+        // Names containing anything besides letters, digits and _ are quoted in braces, as in ${Foo::Bar}.
+        bool parse_symbol(char_queue& input, std::vector<std::string>* names, size_t& sym, std::string* error)
+        {
+            std::string name;
+
+            if (input.peek() == '{')
+            {
+                input.pop();
+
+                while (input && (input.peek() != '}'))
+                {
+                    name.push_back((char) input.peek());
+
+                    input.pop();
+                }
+
+                if (!input)
+                {
+                    if (error)
+                        *error = fmt::format("Missing }} after \"${{{}\"", name);
+
+                    return false;
+                }
+
+                input.pop();
+
+                if (name.empty())
+                {
+                    if (error)
+                        *error = "Empty name in \"${}\"";
+
+                    return false;
+                }
+            }
+            else
+            {
+                while (input)
+                {
+                    int current = input.peek();
+
+                    if (!std::isalnum(current) && (current != '_'))
+                        break;
+
+                    name.push_back((char) current);
+
+                    input.pop();
+                }
+
+                if (name.empty() || (name == "here"))
+                {
+                    sym = sym_here;
+
+                    return true;
+                }
+            }
+
+            if (!names)
+            {
+                if (error)
+                    *error = fmt::format("Can't reference \"{}\" here", name);
+
+                return false;
+            }
+
+            const auto iter = std::find(names->begin(), names->end(), name);
+
+            sym = sym_named + static_cast<size_t>(iter - names->begin());
+
+            if (iter == names->end())
+                names->push_back(std::move(name));
+
+            return true;
+        }
+
+        bool compile_infix(
+            const char* string, std::vector<size_t>& code, std::vector<std::string>* names, std::string* error)
         {
             code.clear();
 
@@ -339,34 +442,10 @@ namespace mem
                 {
                     input.pop();
 
-                    char name[64 + 1];
-                    size_t name_length = 0;
-
-                    while (input)
-                    {
-                        current = input.peek();
-
-                        if (current == ' ')
-                            break;
-
-                        if (name_length + 1 > 64)
-                            return false;
-
-                        name[name_length++] = (char) current;
-                    }
-
-                    name[name_length++] = '\0';
-
                     size_t sym = SIZE_MAX;
 
-                    if (!std::strcmp(name, "") || !std::strcmp(name, "here"))
-                    {
-                        sym = sym_here;
-                    }
-                    else
-                    {
+                    if (!parse_symbol(input, names, sym, error))
                         return false;
-                    }
 
                     push_code(code, {op_sym, 1, {sym}});
                 }
@@ -405,7 +484,8 @@ namespace mem
             return true;
         }
 
-        bool compile_postfix(const char* string, std::vector<size_t>& code)
+        bool compile_postfix(
+            const char* string, std::vector<size_t>& code, std::vector<std::string>* names, std::string* error)
         {
             code.clear();
 
@@ -533,34 +613,10 @@ namespace mem
                 {
                     input.pop();
 
-                    char name[64 + 1];
-                    size_t name_length = 0;
-
-                    while (input)
-                    {
-                        current = input.peek();
-
-                        if (current == ' ')
-                            break;
-
-                        if (name_length + 1 > 64)
-                            return false;
-
-                        name[name_length++] = (char) current;
-                    }
-
-                    name[name_length++] = '\0';
-
                     size_t sym = SIZE_MAX;
 
-                    if (!std::strcmp(name, "") || !std::strcmp(name, "here"))
-                    {
-                        sym = sym_here;
-                    }
-                    else
-                    {
+                    if (!parse_symbol(input, names, sym, error))
                         return false;
-                    }
 
                     code.push_back(op_sym);
                     code.push_back(sym);
@@ -590,217 +646,335 @@ namespace mem
             return true;
         }
 
-        bool execute(
-            const std::vector<size_t>& input, size_t* stack, size_t stack_size, size_t& sp_out, const environment& env)
+        static bool apply_binary(size_t op, size_t lhs, size_t rhs, size_t& out)
         {
-            size_t ip = 0;
-            size_t sp = 0;
+            switch (op)
+            {
+                case op_add: out = lhs + rhs; return true;
+                case op_sub: out = lhs - rhs; return true;
+                case op_mul: out = lhs * rhs; return true;
+                case op_and: out = lhs & rhs; return true;
+                case op_or: out = lhs | rhs; return true;
+                case op_xor: out = lhs ^ rhs; return true;
+
+                case op_div:
+                {
+                    if (rhs == 0)
+                        return false;
+
+                    out = lhs / rhs;
+
+                    return true;
+                }
+
+                case op_mod:
+                {
+                    if (rhs == 0)
+                        return false;
+
+                    out = lhs % rhs;
+
+                    return true;
+                }
+            }
 
-            const size_t* code = input.data();
-            const size_t code_size = input.size();
+            return false;
+        }
+
+        static size_t sign_extend(size_t value, size_t bits)
+        {
+            size_t mask = size_t(1) << (bits - 1);
+
+            return (value ^ mask) - mask;
+        }
+
+        bool compile_program(const std::vector<size_t>& input, program& output)
+        {
+            struct slot
+            {
+                // Whether the value is known, and was pushed by the op_push at code[start]
+                bool constant;
+                size_t value;
+                size_t start;
+            };
+
+            std::vector<slot> stack;
+            std::vector<size_t>& code = output.code;
+
+            code.clear();
+            output.stack_size = 0;
+
+            // Whether the top count values are constants pushed by the last count instructions
+            const auto is_constant = [&](size_t count) {
+                if (stack.size() < count)
+                    return false;
+
+                for (size_t i = 0; i < count; ++i)
+                {
+                    const slot& value = stack[stack.size() - 1 - i];
 
-            std::memset(stack, 0, stack_size * sizeof(size_t));
+                    if (!value.constant || (value.start + (i + 1) * 2 != code.size()))
+                        return false;
+                }
+
+                return true;
+            };
+
+            // Removes the top count constants, and the pushes which produced them
+            const auto pop_constants = [&](size_t count) {
+                code.resize(code.size() - count * 2);
+                stack.resize(stack.size() - count);
+            };
+
+            const auto push_constant = [&](size_t value) {
+                stack.push_back({true, value, code.size()});
+
+                code.push_back(op_push);
+                code.push_back(value);
+            };
+
+            size_t ip = 0;
 
-            while (ip < code_size)
+            while (ip < input.size())
             {
-                size_t op = code[ip++];
+                size_t op = input[ip++];
+
+                // Only these ops have an operand, which is a single value
+                const bool has_operand = (op == op_push) || (op == op_sx) || (op == op_load) || (op == op_sym);
+
+                if (has_operand && (ip + 1 > input.size()))
+                    return false;
 
                 switch (op)
                 {
                     case op_push:
                     {
-                        if (ip + 1 > code_size)
-                            return false;
-
-                        if (sp + 1 > stack_size)
-                            return false;
-
-                        stack[sp++] = code[ip++];
+                        push_constant(input[ip++]);
                     }
                     break;
 
                     case op_add:
+                    case op_sub:
+                    case op_mul:
+                    case op_div:
+                    case op_mod:
+                    case op_and:
+                    case op_or:
+                    case op_xor:
                     {
-                        if (sp < 2)
+                        if (stack.size() < 2)
                             return false;
 
-                        size_t temp = stack[--sp];
+                        size_t value = 0;
 
-                        stack[sp - 1] += temp;
+                        // Division by zero is left to fail when run
+                        if (is_constant(2) &&
+                            apply_binary(op, stack[stack.size() - 2].value, stack[stack.size() - 1].value, value))
+                        {
+                            pop_constants(2);
+                            push_constant(value);
+                        }
+                        else
+                        {
+                            stack.pop_back();
+                            stack.back().constant = false;
+
+                            code.push_back(op);
+                        }
                     }
                     break;
 
-                    case op_sub:
+                    case op_neg:
+                    case op_sx:
                     {
-                        if (sp < 2)
+                        if (stack.size() < 1)
                             return false;
 
-                        size_t temp = stack[--sp];
+                        size_t bits = 0;
+
+                        if (op == op_sx)
+                        {
+                            bits = input[ip++];
+
+                            if ((bits == 0) || (bits > sizeof(size_t) * 8))
+                                return false;
+                        }
+
+                        if (is_constant(1))
+                        {
+                            size_t value = stack.back().value;
+
+                            pop_constants(1);
+                            push_constant((op == op_sx) ? sign_extend(value, bits) : (size_t(0) - value));
+                        }
+                        else
+                        {
+                            stack.back().constant = false;
+
+                            code.push_back(op);
 
-                        stack[sp - 1] -= temp;
+                            if (op == op_sx)
+                                code.push_back(bits);
+                        }
                     }
                     break;
 
-                    case op_mul:
+                    case op_dup:
                     {
-                        if (sp < 2)
+                        if (stack.size() < 1)
                             return false;
 
-                        size_t temp = stack[--sp];
+                        if (is_constant(1))
+                        {
+                            push_constant(stack.back().value);
+                        }
+                        else
+                        {
+                            stack.push_back({false, 0, 0});
 
-                        stack[sp - 1] *= temp;
+                            code.push_back(op_dup);
+                        }
                     }
                     break;
 
-                    case op_div:
+                    case op_drop:
                     {
-                        if (sp < 2)
+                        if (stack.size() < 1)
                             return false;
 
-                        size_t temp = stack[--sp];
-
-                        if (temp == 0)
-                            return false;
+                        if (is_constant(1))
+                        {
+                            pop_constants(1);
+                        }
+                        else
+                        {
+                            stack.pop_back();
 
-                        stack[sp - 1] /= temp;
+                            code.push_back(op_drop);
+                        }
                     }
                     break;
 
-                    case op_mod:
+                    case op_load:
                     {
-                        if (sp < 2)
+                        if (stack.size() < 1)
                             return false;
 
-                        size_t temp = stack[--sp];
+                        size_t size = input[ip++];
 
-                        if (temp == 0)
+                        // A size of 0 reads a pointer
+                        if ((size != 0) && (size != 1) && (size != 2) && (size != 4) && (size != 8))
                             return false;
 
-                        stack[sp - 1] %= temp;
+                        if (size > sizeof(size_t))
+                            return false;
+
+                        stack.back().constant = false;
+
+                        code.push_back(op_load);
+                        code.push_back(size);
                     }
                     break;
 
-                    case op_and:
+                    case op_sym:
                     {
-                        if (sp < 2)
-                            return false;
-
-                        size_t temp = stack[--sp];
+                        stack.push_back({false, 0, 0});
 
-                        stack[sp - 1] &= temp;
+                        code.push_back(op_sym);
+                        code.push_back(input[ip++]);
                     }
                     break;
 
-                    case op_or:
-                    {
-                        if (sp < 2)
-                            return false;
+                    default: { return false;
+                    }
+                }
 
-                        size_t temp = stack[--sp];
+                output.stack_size = std::max(output.stack_size, stack.size());
+            }
+
+            return stack.size() == 1;
+        }
+
+        template <typename Environment>
+        bool run(const program& prog, size_t here, size_t* stack, size_t& out, Environment& env)
+        {
+            const size_t* code = prog.code.data();
+            const size_t* const code_end = code + prog.code.size();
 
-                        stack[sp - 1] |= temp;
+            size_t sp = 0;
+
+            while (code != code_end)
+            {
+                size_t op = *code++;
+
+                switch (op)
+                {
+                    case op_push:
+                    {
+                        stack[sp++] = *code++;
                     }
                     break;
 
+                    case op_add:
+                    case op_sub:
+                    case op_mul:
+                    case op_div:
+                    case op_mod:
+                    case op_and:
+                    case op_or:
                     case op_xor:
                     {
-                        if (sp < 2)
-                            return false;
-
                         size_t temp = stack[--sp];
 
-                        stack[sp - 1] ^= temp;
+                        if (!apply_binary(op, stack[sp - 1], temp, stack[sp - 1]))
+                            return false;
                     }
                     break;
 
                     case op_neg:
                     {
-                        if (sp < 1)
-                            return false;
-
                         stack[sp - 1] = size_t(0) - stack[sp - 1];
                     }
                     break;
 
                     case op_sx:
                     {
-                        if (ip + 1 > code_size)
-                            return false;
-
-                        if (sp < 1)
-                            return false;
-
-                        size_t bits = code[ip++];
-                        size_t mask = size_t(1) << (bits - 1);
-
-                        stack[sp - 1] = (stack[sp - 1] ^ mask) - mask;
+                        stack[sp - 1] = sign_extend(stack[sp - 1], *code++);
                     }
                     break;
 
                     case op_dup:
                     {
-                        if (sp < 1)
-                            return false;
-
-                        if (sp + 1 > stack_size)
-                            return false;
-
-                        size_t temp = stack[sp - 1];
-
-                        stack[sp++] = temp;
+                        stack[sp] = stack[sp - 1];
+                        ++sp;
                     }
                     break;
 
                     case op_drop:
                     {
-                        if (sp < 1)
-                            return false;
-
                         --sp;
                     }
                     break;
 
                     case op_load:
                     {
-                        if (!env.read_integer)
-                            return false;
-
-                        if (ip + 1 > code_size)
-                            return false;
-
-                        if (sp < 1)
-                            return false;
-
                         size_t addr = stack[sp - 1];
-                        size_t size = code[ip++];
 
-                        size_t temp = SIZE_MAX;
-
-                        if (!env.read_integer(addr, size, temp))
+                        if (!env.read_integer(addr, *code++, stack[sp - 1]))
                             return false;
-
-                        stack[sp - 1] = temp;
                     }
                     break;
 
                     case op_sym:
                     {
-                        if (!env.resolve_symbol)
-                            return false;
-
-                        if (ip + 1 > code_size)
-                            return false;
-
-                        if (sp + 1 > stack_size)
-                            return false;
-
-                        size_t sym = code[ip++];
-                        size_t temp = SIZE_MAX;
+                        size_t sym = *code++;
 
-                        if (!env.resolve_symbol(sym, temp))
+                        if (sym == sym_here)
+                            stack[sp] = here;
+                        else if (!env.resolve_symbol(sym, stack[sp]))
                             return false;
 
-                        stack[sp++] = temp;
+                        ++sp;
                     }
                     break;
 
@@ -809,267 +983,1242 @@ namespace mem
                 }
             }
 
-            sp_out = sp;
+            out = stack[0];
 
             return true;
         }
     } // namespace sm
 } // namespace mem
 
-void ProcessPatternFile(Ref<BackgroundTask> task, Ref<BinaryView> view, std::string file_name)
+// Reads values for op_load out of the snapshot, or the view for anything outside of it.
+// Named symbols resolve to the results of the patterns they refer to.
+struct ViewEnvironment
 {
-    const auto total_start_time = stopwatch::now();
+    Ref<BinaryView> view;
+    std::shared_ptr<const brick::view_data> data;
+    const std::vector<uint64_t>& symbols;
+    BinaryReader reader;
+    size_t address_size;
+    bool big_endian;
+
+    ViewEnvironment(Ref<BinaryView> view_, std::shared_ptr<const brick::view_data> data_,
+        const std::vector<uint64_t>& symbols_)
+        : view(view_)
+        , data(std::move(data_))
+        , symbols(symbols_)
+        , reader(view_, view_->GetDefaultEndianness())
+        , address_size(view_->GetAddressSize())
+        , big_endian(view_->GetDefaultEndianness() == BigEndian)
+    {}
+
+    bool read_integer(size_t addr, size_t size, size_t& out)
+    {
+        if (size == 0)
+            size = address_size;
 
-    auto config = YAML::LoadFile(file_name);
+        if (size > sizeof(size_t))
+            return false;
 
-    auto patterns = config["patterns"];
+        uint8_t bytes[sizeof(size_t)];
 
-    if (!patterns || !patterns.IsSequence())
-    {
-        BinjaLog(ErrorLog, "File does not contain any patterns");
+        if (data && data->read(addr, bytes, size))
+        {
+            size_t result = 0;
 
-        return;
+            for (size_t i = 0; i < size; ++i)
+            {
+                result |= size_t(bytes[big_endian ? (size - 1 - i) : i]) << (i * 8);
+            }
+
+            out = result;
+
+            return true;
+        }
+
+        reader.Seek(addr);
+
+        switch (size)
+        {
+            case 1:
+            {
+                uint8_t result;
+                if (!reader.TryRead8(result))
+                {
+                    return false;
+                }
+                out = result;
+                return true;
+            }
+            case 2:
+            {
+                uint16_t result;
+                if (!reader.TryRead16(result))
+                {
+                    return false;
+                }
+                out = result;
+                return true;
+            }
+            case 4:
+            {
+                uint32_t result;
+                if (!reader.TryRead32(result))
+                {
+                    return false;
+                }
+                out = result;
+                return true;
+            }
+            case 8:
+            {
+                uint64_t result;
+                if (!reader.TryRead64(result))
+                {
+                    return false;
+                }
+                out = result;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool resolve_symbol(size_t sym, size_t& out)
+    {
+        if ((sym < mem::sm::sym_named) || (sym - mem::sm::sym_named >= symbols.size()))
+            return false;
+
+        out = symbols[sym - mem::sm::sym_named];
+
+        return true;
+    }
+};
+
+// Accepts either a single scope string, or a sequence of them
+static bool ReadScope(const YAML::Node& node, std::vector<std::string>& scope)
+{
+    if (node.IsScalar())
+    {
+        scope.push_back(node.as<std::string>());
+
+        return true;
+    }
+
+    if (node.IsSequence())
+    {
+        for (const YAML::Node& item : node)
+        {
+            scope.push_back(item.as<std::string>());
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+static bool ParseScope(const std::vector<std::string>& strings, brick::scan_scope& scope)
+{
+    for (const std::string& string : strings)
+    {
+        if (!scope.parse(string))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+struct PatternEntry
+{
+    const brick::compiled_pattern* source {nullptr};
+
+    mem::pattern pattern;
+    mem::sm::program program;
+
+    std::vector<brick::address_range> ranges;
+
+    // Matches of the pattern, before any ops were applied
+    std::vector<uint64_t> scan_results;
+    std::vector<uint64_t> results;
+
+    // Cleared if the entry failed to parse, and shouldn't be scanned
+    bool valid {true};
+
+    // See GetScanKey and GetEntryHash
+    uint64_t scan_key {0};
+    uint64_t entry_hash {0};
+
+    // Set if the scan results were kept from the last load, instead of scanning again
+    bool reused {false};
+
+    // Set if the entry was scanned by this load. Entries which were neither scanned nor reused have no results.
+    bool scanned {false};
+
+    // Set if the same entry was applied at previous_address by the last load
+    bool applied {false};
+    uint64_t previous_address {0};
+
+    // Index of the entry each of source->references refers to
+    std::vector<size_t> dependencies;
+
+    // Set once the entry has resolved to a single address
+    bool found {false};
+    uint64_t address {0};
+
+    // Entries are evaluated in parallel, so anything they log is kept until they can be applied in order
+    std::vector<std::pair<BNLogLevel, std::string>> messages;
+
+    template <typename... Args>
+    void log(BNLogLevel level, const char* format, const Args&... args)
+    {
+        messages.emplace_back(level, fmt::format(format, args...));
+    }
+};
+
+static bool SameRanges(const std::vector<brick::address_range>& lhs, const std::vector<brick::address_range>& rhs)
+{
+    return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(),
+        [](const brick::address_range& a, const brick::address_range& b) {
+            return (a.start == b.start) && (a.end == b.end);
+        });
+}
+
+// Compiles the pattern and ops of an entry. Safe to call from any thread.
+static void CompileEntry(brick::compiled_pattern& compiled)
+{
+    const mem::pattern pattern(compiled.pattern_string.c_str());
+
+    if (!pattern)
+    {
+        compiled.errors.push_back(fmt::format("Pattern \"{}\" is empty or malformed", compiled.pattern_string));
+
+        return;
+    }
+
+    compiled.bytes.assign(pattern.bytes(), pattern.bytes() + pattern.size());
+    compiled.masks.assign(pattern.masks(), pattern.masks() + pattern.size());
+
+    if (compiled.has_ops)
+    {
+        std::vector<size_t> expr;
+        mem::sm::program program;
+        std::string error;
+
+        if (!mem::sm::compile_infix(compiled.ops_string.c_str(), expr, &compiled.references, &error))
+        {
+            if (error.empty())
+            {
+                compiled.errors.push_back(fmt::format("Error parsing \"{}\"", compiled.ops_string));
+            }
+            else
+            {
+                compiled.errors.push_back(fmt::format("Error parsing \"{}\": {}", compiled.ops_string, error));
+            }
+        }
+        else if (!mem::sm::compile_program(expr, program))
+        {
+            compiled.errors.push_back(fmt::format("{}: Invalid Operands \"{}\"", compiled.name, compiled.ops_string));
+        }
+        else
+        {
+            compiled.code.assign(program.code.begin(), program.code.end());
+            compiled.stack_size = program.stack_size;
+        }
+    }
+}
+
+// mem::sm::run doesn't check the code it runs, so code read back from the cache is compiled again.
+// compile_program leaves code it produced unchanged, so anything else was corrupted or written by another version.
+static bool VerifyCachedEntry(brick::compiled_pattern& compiled)
+{
+    if (!compiled.errors.empty() || !compiled.has_ops)
+    {
+        return true;
+    }
+
+    const std::vector<size_t> expr(compiled.code.begin(), compiled.code.end());
+
+    // Values too large for a size_t
+    if (!std::equal(expr.begin(), expr.end(), compiled.code.begin(), compiled.code.end()))
+    {
+        return false;
+    }
+
+    mem::sm::program program;
+
+    if (!mem::sm::compile_program(expr, program) || (program.code != expr))
+    {
+        return false;
+    }
+
+    // Constants which were folded away no longer count towards it, so it can be smaller than the stored one
+    compiled.stack_size = program.stack_size;
+
+    return true;
+}
+
+// Parses and compiles every entry of a pattern file
+static bool CompilePatternFile(
+    const std::string& file_name, const std::string& contents, brick::compiled_pattern_file& compiled)
+{
+    YAML::Node config;
+
+    try
+    {
+        config = YAML::Load(contents);
+    }
+    catch (const std::exception& ex)
+    {
+        BinjaLog(ErrorLog, "Error parsing pattern file \"{}\": {}", file_name, ex.what());
+
+        return false;
+    }
+
+    auto patterns = config["patterns"];
+
+    if (!patterns || !patterns.IsSequence())
+    {
+        BinjaLog(ErrorLog, "File does not contain any patterns");
+
+        return false;
+    }
+
+    brick::scan_scope default_scope;
+
+    if (config["scope"] &&
+        (!ReadScope(config["scope"], compiled.scope) || !ParseScope(compiled.scope, default_scope)))
+    {
+        BinjaLog(ErrorLog, "Invalid default scope");
+
+        return false;
+    }
+
+    compiled.patterns.resize(patterns.size());
+
+    // YAML nodes can't be shared between threads, so everything needed from them is copied out first
+    for (size_t i = 0; i < compiled.patterns.size(); ++i)
+    {
+        brick::compiled_pattern& entry = compiled.patterns[i];
+
+        try
+        {
+            const YAML::Node n = patterns[i];
+
+            entry.name = n["name"].as<std::string>();
+            entry.type = n["category"].as<std::string>();
+            entry.pattern_string = n["pattern"].as<std::string>();
+            entry.count = n["count"].as<uint64_t>(1);
+            entry.index = n["index"].as<uint64_t>(0);
+
+            if (const auto ops = n["ops"])
+            {
+                if (ops.IsScalar())
+                {
+                    entry.has_ops = true;
+                    entry.ops_string = ops.as<std::string>();
+                }
+                else
+                {
+                    entry.errors.push_back(fmt::format("Invalid Operands for {}", entry.name));
+                }
+            }
+
+            if (const auto scope_node = n["scope"])
+            {
+                brick::scan_scope scope;
+
+                entry.has_scope = true;
+
+                if (!ReadScope(scope_node, entry.scope) || !ParseScope(entry.scope, scope))
+                {
+                    entry.errors.push_back(fmt::format("{}: Invalid scope", entry.name));
+                }
+            }
+        }
+        catch (const std::exception& ex)
+        {
+            entry.errors.push_back(fmt::format("Error parsing pattern file \"{}\": {}", file_name, ex.what()));
+        }
+        catch (...)
+        {
+            entry.errors.push_back(fmt::format("Error parsing pattern file \"{}\"", file_name));
+        }
+    }
+
+    parallel_for_each(compiled.patterns.begin(), compiled.patterns.end(), [](brick::compiled_pattern& entry) -> bool {
+        if (entry.errors.empty())
+        {
+            CompileEntry(entry);
+        }
+
+        return true;
+    });
+
+    return true;
+}
+
+// Applies the ops of an entry to its results, and picks the final address. Safe to call from any thread.
+static void EvaluateEntry(Ref<BinaryView> view, std::shared_ptr<const brick::view_data> data,
+    const std::vector<uint64_t>& symbols, PatternEntry& entry)
+{
+    const brick::compiled_pattern& source = *entry.source;
+    const std::string& name = source.name;
+
+    std::vector<uint64_t>& results = entry.results;
+
+    results = entry.scan_results;
+
+    if (results.empty())
+    {
+        entry.log(ErrorLog, "Pattern \"{}\" (\"{}\") not found", name, source.pattern_string);
+
+        return;
+    }
+
+    if (source.has_ops)
+    {
+        ViewEnvironment env(view, std::move(data), symbols);
+
+        // Shared by every result, so evaluating them doesn't allocate
+        std::vector<size_t> stack(entry.program.stack_size);
+
+        size_t failed = 0;
+
+        auto out = results.begin();
+
+        for (uint64_t result : results)
+        {
+            size_t value = 0;
+
+            if (mem::sm::run(entry.program, result, stack.data(), value, env))
+            {
+                *out++ = value;
+            }
+            else
+            {
+                ++failed;
+            }
+        }
+
+        results.erase(out, results.end());
+
+        if (failed != 0)
+        {
+            entry.log(ErrorLog, "{}: Eval Failed for {} of {} results", name, failed, results.size() + failed);
+        }
+    }
+
+    if (results.empty())
+    {
+        entry.log(ErrorLog, "Not Found: {}\n", name);
+    }
+
+    std::unordered_set<uint64_t> unique_scan_results(results.begin(), results.end());
+
+    if (unique_scan_results.size() != 1)
+    {
+        if (source.count != results.size())
+        {
+            entry.log(ErrorLog, "{}: Invalid Count: (Got {}, Expected {})", name, results.size(), source.count);
+
+            return;
+        }
+
+        if (source.index >= results.size())
+        {
+            entry.log(ErrorLog, "{}: Invalid Index: {}, {} Results", name, source.index, results.size());
+
+            return;
+        }
+
+        unique_scan_results = {results.at(static_cast<size_t>(source.index))};
+    }
+
+    entry.found = true;
+    entry.address = *unique_scan_results.begin();
+}
+
+// Resolves the entries referenced by each entry's ops, and splits them into waves which only depend on earlier ones.
+// Entries referring to unknown patterns, or part of a cycle, are logged and marked invalid.
+static std::vector<std::vector<size_t>> ScheduleEntries(std::vector<PatternEntry>& entries)
+{
+    // SIZE_MAX for names used by more than one entry
+    std::unordered_map<std::string, size_t> names;
+
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        if (entries[i].valid)
+        {
+            auto result = names.emplace(entries[i].source->name, i);
+
+            if (!result.second)
+            {
+                result.first->second = SIZE_MAX;
+            }
+        }
+    }
+
+    std::vector<size_t> pending(entries.size(), 0);
+    std::vector<std::vector<size_t>> dependents(entries.size());
+
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        PatternEntry& entry = entries[i];
+
+        if (!entry.valid)
+        {
+            continue;
+        }
+
+        for (const std::string& reference : entry.source->references)
+        {
+            const auto iter = names.find(reference);
+
+            if (iter == names.end())
+            {
+                entry.log(ErrorLog, "{}: Unknown or invalid pattern ${}", entry.source->name, reference);
+                entry.valid = false;
+            }
+            else if (iter->second == SIZE_MAX)
+            {
+                entry.log(ErrorLog, "{}: Ambiguous reference to ${}", entry.source->name, reference);
+                entry.valid = false;
+            }
+            else
+            {
+                entry.dependencies.push_back(iter->second);
+            }
+        }
+
+        if (!entry.valid)
+        {
+            entry.dependencies.clear();
+
+            continue;
+        }
+
+        for (size_t dependency : entry.dependencies)
+        {
+            dependents[dependency].push_back(i);
+        }
+
+        pending[i] = entry.dependencies.size();
+    }
+
+    std::vector<std::vector<size_t>> waves;
+    std::vector<size_t> current;
+
+    // Invalid entries are still scheduled, so anything depending on them finds out they weren't found
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        if (pending[i] == 0)
+        {
+            current.push_back(i);
+        }
+    }
+
+    while (!current.empty())
+    {
+        std::vector<size_t> next;
+
+        for (size_t i : current)
+        {
+            for (size_t dependent : dependents[i])
+            {
+                if (--pending[dependent] == 0)
+                {
+                    next.push_back(dependent);
+                }
+            }
+        }
+
+        // Keep each wave in file order
+        std::sort(next.begin(), next.end());
+
+        waves.push_back(std::move(current));
+        current = std::move(next);
+    }
+
+    // Anything left waiting is part of, or depends on, a cycle
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        PatternEntry& entry = entries[i];
+
+        if (entry.valid && (pending[i] != 0))
+        {
+            std::string waiting;
+
+            for (size_t j = 0; j < entry.dependencies.size(); ++j)
+            {
+                if (pending[entry.dependencies[j]] != 0)
+                {
+                    waiting += fmt::format(" ${}", entry.source->references[j]);
+                }
+            }
+
+            entry.log(ErrorLog, "{}: Circular reference through{}", entry.source->name, waiting);
+            entry.valid = false;
+        }
+    }
+
+    return waves;
+}
+
+// Finds every valid entry which wasn't reused, streaming the view if there is no snapshot
+static void ScanEntries(
+    Ref<BinaryView> view, const std::shared_ptr<const brick::view_data>& data, std::vector<PatternEntry>& entries)
+{
+    // Patterns sharing a scope are compiled into one multi_scanner, and found in a single parallel pass over it
+    std::vector<bool> scanned(entries.size(), false);
+
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        if (scanned[i] || !entries[i].valid || entries[i].reused)
+        {
+            continue;
+        }
+
+        std::vector<size_t> group;
+        std::vector<mem::pattern> group_patterns;
+
+        for (size_t j = i; j < entries.size(); ++j)
+        {
+            if (!scanned[j] && entries[j].valid && !entries[j].reused &&
+                SameRanges(entries[i].ranges, entries[j].ranges))
+            {
+                scanned[j] = true;
+                group.push_back(j);
+                group_patterns.push_back(entries[j].pattern);
+            }
+        }
+
+        brick::multi_scanner scanner(std::move(group_patterns), data ? &data->histogram() : nullptr);
+
+        std::vector<std::vector<uint64_t>> group_results = data
+            ? scanner.scan_all(data->regions(entries[i].ranges))
+            : scanner.stream_scan_all(view, entries[i].ranges);
+
+        for (size_t j = 0; j < group.size(); ++j)
+        {
+            entries[group[j]].scan_results = std::move(group_results[j]);
+            entries[group[j]].scanned = true;
+        }
+    }
+}
+
+// Hash of the pattern and the ranges it's scanned in, which is all its scan results depend on besides the view
+static uint64_t GetScanKey(const PatternEntry& entry)
+{
+    const uint64_t range_count = entry.ranges.size();
+
+    uint64_t key = brick::hash_bytes(entry.pattern.bytes(), entry.pattern.size());
+
+    key = brick::hash_bytes(entry.pattern.masks(), entry.pattern.size(), key);
+    key = brick::hash_bytes(&range_count, sizeof(range_count), key);
+    key = brick::hash_bytes(entry.ranges.data(), entry.ranges.size() * sizeof(brick::address_range), key);
+
+    return key;
+}
+
+// Hash of everything in the entry, which decides what gets applied to the view
+static uint64_t GetEntryHash(const brick::compiled_pattern& source)
+{
+    uint64_t hash = 0;
+
+    const auto add_string = [&hash](const std::string& value) {
+        const uint64_t length = value.size();
+
+        hash = brick::hash_bytes(&length, sizeof(length), hash);
+        hash = brick::hash_bytes(value.data(), value.size(), hash);
+    };
+
+    add_string(source.name);
+    add_string(source.type);
+    add_string(source.pattern_string);
+    add_string(source.has_ops ? source.ops_string : std::string());
+
+    for (const std::string& scope : source.scope)
+    {
+        add_string(scope);
+    }
+
+    const uint64_t values[] {source.has_ops, source.has_scope, source.scope.size(), source.count, source.index};
+
+    return brick::hash_bytes(values, sizeof(values), hash);
+}
+
+// Each pattern file keeps the results of its last load in the view's metadata
+static std::string GetLoadKey(const std::string& file_name)
+{
+    std::error_code error;
+
+    const std::string path = std::filesystem::weakly_canonical(std::filesystem::u8path(file_name), error).u8string();
+
+    return fmt::format("pattern.load.{:016X}", brick::hash_bytes(path.data(), path.size()));
+}
+
+// Symbols defined by the last load of a pattern file
+struct PreviousLoad
+{
+    std::vector<std::string> names;
+    std::vector<uint64_t> addresses;
+};
+
+// Saves the scan results of every entry, and what was applied, so the next load only has to scan what changed.
+// content_hash is 0 when the view was streamed rather than read into a snapshot, so the results are never reused.
+static void StoreLoad(Ref<BinaryView> view, const std::string& load_key, uint64_t content_hash,
+    const std::vector<PatternEntry>& entries)
+{
+    std::vector<uint64_t> scan_keys;
+    std::vector<uint64_t> entry_hashes;
+    std::vector<Ref<Metadata>> results;
+    std::vector<std::string> names;
+    std::vector<uint64_t> addresses;
+
+    for (const PatternEntry& entry : entries)
+    {
+        // Entries which were never scanned (e.g. because they reference a missing entry) have no results to reuse
+        scan_keys.push_back((entry.scanned || entry.reused) ? entry.scan_key : 0);
+        entry_hashes.push_back(entry.entry_hash);
+        results.push_back(new Metadata(entry.scan_results));
+
+        names.push_back(entry.found ? entry.source->name : std::string());
+        addresses.push_back(entry.found ? entry.address : 0);
     }
 
-    const brick::view_data data(view);
+    std::map<std::string, Ref<Metadata>> record;
 
-    std::for_each(patterns.begin(), patterns.end(), [&](const YAML::Node& n) -> bool {
-        try
-        {
-            std::string name = n["name"].as<std::string>();
-            std::string type = n["category"].as<std::string>();
-            std::string desc = n["desc"].as<std::string>("");
-            std::string pattern_string = n["pattern"].as<std::string>();
+    record["content_hash"] = new Metadata(content_hash);
+    record["scan_keys"] = new Metadata(scan_keys);
+    record["entry_hashes"] = new Metadata(entry_hashes);
+    record["results"] = new Metadata(results);
+    record["names"] = new Metadata(names);
+    record["addresses"] = new Metadata(addresses);
 
-            mem::pattern pattern(pattern_string.c_str());
+    view->StoreMetadata(load_key, new Metadata(record));
+}
 
-            if (!pattern)
-            {
-                BinjaLog(ErrorLog, "Pattern \"{}\" is empty or malformed", pattern_string);
+static bool GetUnsignedIntegerList(
+    const std::map<std::string, Ref<Metadata>>& values, const char* name, std::vector<uint64_t>& output)
+{
+    const auto iter = values.find(name);
 
-                return true;
-            }
+    if (iter == values.end())
+    {
+        return false;
+    }
 
-            mem::default_scanner scanner(pattern);
+    // Empty lists may come back as plain arrays
+    if (iter->second->IsUnsignedIntegerList())
+    {
+        output = iter->second->GetUnsignedIntegerList();
 
-            std::vector<uint64_t> scan_results = data.scan_all(scanner);
+        return true;
+    }
 
-            if (scan_results.empty())
-            {
-                BinjaLog(ErrorLog, "Pattern \"{}\" (\"{}\") not found", name, pattern_string);
+    return iter->second->IsArray() && iter->second->GetArray().empty();
+}
 
-                return true;
-            }
+// Returns whether the entry's stored results still match the snapshot
+static bool VerifyResults(const brick::view_data& data, const PatternEntry& entry)
+{
+    const mem::byte* bytes = entry.pattern.bytes();
+    const mem::byte* masks = entry.pattern.masks();
+
+    std::vector<uint8_t> buffer(entry.pattern.size());
+
+    for (uint64_t address : entry.scan_results)
+    {
+        if (!data.read(address, buffer.data(), buffer.size()))
+        {
+            return false;
+        }
 
+        for (size_t i = 0; i < buffer.size(); ++i)
+        {
+            if ((buffer[i] & masks[i]) != bytes[i])
             {
-                const auto ops = n["ops"];
+                return false;
+            }
+        }
+    }
 
-                if (ops)
-                {
-                    if (ops.IsScalar())
-                    {
-                        std::vector<size_t> expr;
+    return true;
+}
 
-                        std::string ops_string = ops.as<std::string>();
+// Reuses the scan results of entries which haven't changed since the last load, if the view hasn't either.
+// Without a snapshot (data is null), only the symbols defined by the last load are read, so they can be replaced.
+// Returns the number of entries reused.
+static size_t ReusePreviousLoad(Ref<BinaryView> view, const brick::view_data* data, const std::string& load_key,
+    std::vector<PatternEntry>& entries, PreviousLoad& previous)
+{
+    Ref<Metadata> record = view->QueryMetadata(load_key);
 
-                        if (!mem::sm::compile_infix(ops_string.c_str(), expr))
-                        {
-                            BinjaLog(ErrorLog, "Error parsing \"{}\"", ops_string);
+    if (!record || !record->IsKeyValueStore())
+    {
+        return 0;
+    }
 
-                            return true;
-                        }
+    std::map<std::string, Ref<Metadata>> values = record->GetKeyValueStore();
 
-                        BinaryReader reader(view, view->GetDefaultEndianness());
+    std::vector<uint64_t> scan_keys;
+    std::vector<uint64_t> entry_hashes;
+    std::vector<uint64_t> addresses;
 
-                        for (auto iter = scan_results.begin(); iter != scan_results.end();)
-                        {
-                            size_t sp_out = SIZE_MAX;
-                            size_t stack[16];
-
-                            mem::sm::environment env;
-
-                            env.read_integer = [view, &reader](size_t addr, size_t size, size_t& out) -> bool {
-                                if (size == 0)
-                                    size = view->GetAddressSize();
-
-                                if (size > sizeof(size_t))
-                                    return false;
-
-                                reader.Seek(addr);
-
-                                switch (size)
-                                {
-                                    case 1:
-                                    {
-                                        uint8_t result;
-                                        if (!reader.TryRead8(result))
-                                        {
-                                            return false;
-                                        }
-                                        out = result;
-                                        return true;
-                                    }
-                                    case 2:
-                                    {
-                                        uint16_t result;
-                                        if (!reader.TryRead16(result))
-                                        {
-                                            return false;
-                                        }
-                                        out = result;
-                                        return true;
-                                    }
-                                    case 4:
-                                    {
-                                        uint32_t result;
-                                        if (!reader.TryRead32(result))
-                                        {
-                                            return false;
-                                        }
-                                        out = result;
-                                        return true;
-                                    }
-                                    case 8:
-                                    {
-                                        uint64_t result;
-                                        if (!reader.TryRead64(result))
-                                        {
-                                            return false;
-                                        }
-                                        out = result;
-                                        return true;
-                                    }
-                                }
+    const auto content_hash = values.find("content_hash");
+    const auto results = values.find("results");
+    const auto names = values.find("names");
 
-                                return false;
-                            };
+    if ((content_hash == values.end()) || (results == values.end()) || (names == values.end()) ||
+        !content_hash->second->IsUnsignedInteger() || !results->second->IsArray() ||
+        !GetUnsignedIntegerList(values, "scan_keys", scan_keys) ||
+        !GetUnsignedIntegerList(values, "entry_hashes", entry_hashes) ||
+        !GetUnsignedIntegerList(values, "addresses", addresses))
+    {
+        return 0;
+    }
 
-                            size_t here = *iter;
+    std::vector<Ref<Metadata>> result_lists = results->second->GetArray();
 
-                            env.resolve_symbol = [here](size_t sym, size_t& out) -> bool {
-                                switch (sym)
-                                {
-                                    case mem::sm::sym_here:
-                                    {
-                                        out = here;
+    // An empty list of names may not come back as a string list
+    if (names->second->IsStringList())
+    {
+        previous.names = names->second->GetStringList();
+    }
 
-                                        return true;
-                                    };
-                                }
+    const size_t count = scan_keys.size();
 
-                                return false;
-                            };
-
-                            if (mem::sm::execute(expr, stack, 16, sp_out, env) && (sp_out == 1))
-                            {
-                                *iter++ = stack[0];
-                            }
-                            else
-                            {
-                                BinjaLog(ErrorLog, "Eval Failed");
-
-                                iter = scan_results.erase(iter);
-                            }
-                        }
-                    }
-                    else
-                    {
-                        BinjaLog(ErrorLog, "Invalid Operands for {}", name);
-                    }
+    if ((entry_hashes.size() != count) || (addresses.size() != count) || (result_lists.size() != count) ||
+        (previous.names.size() != count))
+    {
+        previous.names.clear();
+
+        return 0;
+    }
+
+    previous.addresses = addresses;
+
+    if (!data)
+    {
+        BinjaLog(InfoLog, "View is being streamed, so the results of the last load can't be reused");
+
+        return 0;
+    }
+
+    // Nothing can be reused if the view has changed, but the old symbols still need replacing
+    if ((content_hash->second->GetUnsignedInteger() == 0) ||
+        (content_hash->second->GetUnsignedInteger() != data->content_hash()))
+    {
+        return 0;
+    }
+
+    std::unordered_map<uint64_t, size_t> previous_scans;
+    std::unordered_map<uint64_t, size_t> previous_entries;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (scan_keys[i] != 0)
+        {
+            previous_scans.emplace(scan_keys[i], i);
+        }
+
+        previous_entries.emplace(entry_hashes[i], i);
+    }
+
+    for (PatternEntry& entry : entries)
+    {
+        if (!entry.valid)
+        {
+            continue;
+        }
+
+        const auto scan = previous_scans.find(entry.scan_key);
+
+        if (scan == previous_scans.end())
+        {
+            continue;
+        }
+
+        Ref<Metadata> list = result_lists[scan->second];
+
+        if (list->IsUnsignedIntegerList())
+        {
+            entry.scan_results = list->GetUnsignedIntegerList();
+        }
+        else if (!list->IsArray() || !list->GetArray().empty())
+        {
+            continue;
+        }
+
+        entry.reused = true;
+
+        const auto applied = previous_entries.find(entry.entry_hash);
+
+        if ((applied != previous_entries.end()) && !previous.names[applied->second].empty())
+        {
+            entry.previous_address = addresses[applied->second];
+            entry.applied = true;
+        }
+    }
+
+    std::atomic<bool> matches {true};
+
+    // The hash should catch any changes, but checking each result still matches is cheap
+    parallel_for_each(entries.begin(), entries.end(), [&](const PatternEntry& entry) -> bool {
+        if (entry.reused && !VerifyResults(*data, entry))
+        {
+            matches = false;
+        }
+
+        return matches.load(std::memory_order_relaxed);
+    });
+
+    size_t reused = 0;
+
+    for (PatternEntry& entry : entries)
+    {
+        if (!matches)
+        {
+            entry.scan_results.clear();
+            entry.reused = false;
+            entry.applied = false;
+        }
+        else if (entry.reused)
+        {
+            ++reused;
+        }
+    }
+
+    return reused;
+}
+
+// Groups every change made while it's alive into one undo action, and defers updating symbols until it's destroyed.
+// Both are ended even if applying the entries throws.
+class ApplyGuard
+{
+private:
+    Ref<BinaryView> view_;
+    std::string undo_id_;
+
+public:
+    ApplyGuard(Ref<BinaryView> view)
+        : view_(view)
+        , undo_id_(view->BeginUndoActions())
+    {
+        view_->BeginBulkModifySymbols();
+    }
+
+    ApplyGuard(const ApplyGuard&) = delete;
+    ApplyGuard& operator=(const ApplyGuard&) = delete;
+
+    ~ApplyGuard()
+    {
+        view_->EndBulkModifySymbols();
+        view_->CommitUndoActions(undo_id_);
+    }
+};
+
+// Whether the symbol is still defined by the user at the address. It may have since been undone, renamed or removed.
+static bool HasUserSymbol(Ref<BinaryView> view, const std::string& name, uint64_t address, BNSymbolType type)
+{
+    for (Ref<Symbol> symbol : view->GetSymbolsByName(name))
+    {
+        if ((symbol->GetAddress() == address) && (symbol->GetType() == type) && !symbol->IsAutoDefined())
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ProcessPatternFile(Ref<BackgroundTask> task, Ref<BinaryView> view, std::string file_name)
+{
+    const auto total_start_time = stopwatch::now();
+
+    std::string contents;
+
+    {
+        std::ifstream input(std::filesystem::u8path(file_name), std::ios::binary);
+
+        if (!input)
+        {
+            BinjaLog(ErrorLog, "Failed to open pattern file \"{}\"", file_name);
+
+            return;
+        }
+
+        contents.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+    }
+
+    brick::compiled_pattern_file compiled;
+
+    const uint64_t hash = brick::hash_bytes(contents.data(), contents.size());
+    const bool use_cache = brick::is_pattern_cache_enabled();
+
+    // Only parse the YAML if it has changed since it was last compiled
+    bool from_cache = use_cache && brick::load_pattern_cache(file_name, hash, compiled);
+
+    if (from_cache &&
+        !std::all_of(compiled.patterns.begin(), compiled.patterns.end(),
+            [](brick::compiled_pattern& pattern) { return VerifyCachedEntry(pattern); }))
+    {
+        BinjaLog(WarningLog, "Cached copy of \"{}\" is invalid, compiling it again", file_name);
+
+        from_cache = false;
+    }
+
+    if (!from_cache)
+    {
+        compiled = brick::compiled_pattern_file {};
+        compiled.hash = hash;
+
+        if (!CompilePatternFile(file_name, contents, compiled))
+        {
+            return;
+        }
+
+        if (use_cache)
+        {
+            brick::save_pattern_cache(file_name, compiled);
+        }
+    }
+
+    const auto compile_end_time = stopwatch::now();
+
+    brick::scan_scope default_scope;
+    ParseScope(compiled.scope, default_scope);
+
+    const std::vector<brick::address_range> default_ranges = default_scope.resolve(view);
+
+    std::vector<PatternEntry> entries(compiled.patterns.size());
+
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        PatternEntry& entry = entries[i];
+        const brick::compiled_pattern& source = compiled.patterns[i];
+
+        entry.source = &source;
+
+        for (const std::string& error : source.errors)
+        {
+            entry.log(ErrorLog, "{}", error);
+        }
+
+        if (!source.errors.empty())
+        {
+            entry.valid = false;
+
+            continue;
+        }
+
+        entry.pattern = mem::pattern(source.bytes.data(), source.masks.data(), source.bytes.size());
+
+        if (source.has_ops)
+        {
+            entry.program.code.assign(source.code.begin(), source.code.end());
+            entry.program.stack_size = static_cast<size_t>(source.stack_size);
+        }
+
+        if (source.has_scope)
+        {
+            brick::scan_scope scope;
+            ParseScope(source.scope, scope);
+
+            entry.ranges = scope.resolve(view);
+        }
+        else
+        {
+            entry.ranges = default_ranges;
+        }
+
+        entry.scan_key = GetScanKey(entry);
+        entry.entry_hash = GetEntryHash(source);
+    }
+
+    // Entries which can never be evaluated are found before scanning for them
+    const std::vector<std::vector<size_t>> waves = ScheduleEntries(entries);
+
+    std::shared_ptr<const brick::view_data> data;
+
+    // Views too large to keep in memory are read a chunk at a time for each pattern instead
+    if (!brick::should_stream(view))
+    {
+        data = brick::get_view_data(view);
+    }
+
+    const std::string load_key = GetLoadKey(file_name);
+
+    PreviousLoad previous;
+
+    // Only scan entries which are new or have changed since the last time this file was loaded
+    const size_t reused_count = ReusePreviousLoad(view, data.get(), load_key, entries, previous);
+
+    ScanEntries(view, data, entries);
+
+    // Entries only depend on those in earlier waves, so each wave can be evaluated in parallel
+    for (const std::vector<size_t>& wave : waves)
+    {
+        parallel_for_each(wave.begin(), wave.end(), [&](size_t index) -> bool {
+            PatternEntry& entry = entries[index];
+
+            if (!entry.valid)
+            {
+                return true;
+            }
+
+            std::vector<uint64_t> symbols;
+
+            for (size_t i = 0; i < entry.dependencies.size(); ++i)
+            {
+                const PatternEntry& dependency = entries[entry.dependencies[i]];
+
+                if (!dependency.found)
+                {
+                    entry.log(ErrorLog, "{}: ${} was not found", entry.source->name, entry.source->references[i]);
+
+                    return true;
                 }
+
+                symbols.push_back(dependency.address);
             }
 
-            if (scan_results.empty())
+            try
+            {
+                EvaluateEntry(view, data, symbols, entry);
+            }
+            catch (const std::exception& ex)
+            {
+                entry.log(ErrorLog, "Error parsing pattern file \"{}\": {}", file_name, ex.what());
+            }
+            catch (...)
             {
-                BinjaLog(ErrorLog, "Not Found: {}\n", name);
+                entry.log(ErrorLog, "Error parsing pattern file \"{}\"", file_name);
             }
 
-            std::unordered_set<uint64_t> unique_scan_results(scan_results.begin(), scan_results.end());
+            return true;
+        });
+    }
+
+    const auto apply_start_time = stopwatch::now();
+
+    size_t found_count = 0;
+    size_t removed_count = 0;
 
-            if (unique_scan_results.size() != 1)
+    // Everything is defined as one undo action, and analyzed once at the end rather than after every symbol
+    {
+        ApplyGuard guard(view);
+
+        std::set<std::pair<std::string, uint64_t>> defined;
+
+        for (const PatternEntry& entry : entries)
+        {
+            if (entry.found)
             {
-                {
-                    const auto count = n["count"].as<size_t>(1);
+                defined.emplace(entry.source->name, entry.address);
+            }
+        }
 
-                    if (count != scan_results.size())
-                    {
-                        BinjaLog(
-                            ErrorLog, "{}: Invalid Count: (Got {}, Expected {})", name, scan_results.size(), count);
+        // Remove symbols from the last load whose entry has since been removed, or now resolves elsewhere
+        for (size_t i = 0; i < previous.names.size(); ++i)
+        {
+            const std::string& name = previous.names[i];
+            const uint64_t address = previous.addresses[i];
 
-                        return true;
-                    }
+            if (name.empty() || defined.count({name, address}))
+            {
+                continue;
+            }
+
+            for (Ref<Symbol> symbol : view->GetSymbolsByName(name))
+            {
+                if ((symbol->GetAddress() != address) || symbol->IsAutoDefined())
+                {
+                    continue;
                 }
 
+                // Also remove the function created for it, unless analysis found the function by itself
+                if (symbol->GetType() == FunctionSymbol)
                 {
-                    const auto index = n["index"].as<size_t>(0);
+                    Ref<Platform> platform = view->GetDefaultPlatform();
+                    Ref<Function> function = platform ? view->GetAnalysisFunction(platform, address) : nullptr;
 
-                    if (index >= scan_results.size())
+                    if (function && !function->WasAutomaticallyDiscovered())
                     {
-                        BinjaLog(ErrorLog, "{}: Invalid Index: {}, {} Results", name, index, scan_results.size());
-
-                        return true;
+                        view->RemoveUserFunction(function);
                     }
-
-                    unique_scan_results = {scan_results.at(index)};
                 }
+
+                view->UndefineUserSymbol(symbol);
+
+                ++removed_count;
             }
+        }
 
-            if (unique_scan_results.size() != 1)
+        // Symbols are defined in file order, so later entries still win over earlier ones
+        for (PatternEntry& entry : entries)
+        {
+            for (const auto& message : entry.messages)
             {
-                std::string error;
+                BinjaLog(message.first, "{}", message.second);
+            }
 
-                for (auto result : unique_scan_results)
-                {
-                    error += fmt::format(" @ 0x{:X}\n", result);
-                }
+            if (!entry.found)
+            {
+                continue;
+            }
 
-                BinjaLog(ErrorLog, "Differing Results: {}\n{}", name, error);
+            const uint64_t offset = entry.address;
 
-                return true;
-            }
+            BinjaLog(InfoLog, "Found {} @ 0x{:X}\n", entry.source->name, offset);
 
-            uint64_t offset = *unique_scan_results.begin();
+            ++found_count;
 
-            BinjaLog(InfoLog, "Found {} @ 0x{:X}\n", name, offset);
+            const bool is_function = entry.source->type == "Function";
+            const BNSymbolType symbol_type = is_function ? FunctionSymbol : DataSymbol;
 
-            BNSymbolType symbol_type = DataSymbol;
+            Ref<Platform> platform = is_function ? view->GetDefaultPlatform() : nullptr;
 
-            if (type == "Function")
+            // Already defined by the last load, and still there
+            if (entry.applied && (entry.previous_address == offset) &&
+                HasUserSymbol(view, entry.source->name, offset, symbol_type) &&
+                (!platform || view->GetAnalysisFunction(platform, offset)))
             {
-                Ref<Platform> platform = view->GetDefaultPlatform();
-
-                if (platform)
-                {
-                    view->CreateUserFunction(platform, offset);
-                }
+                continue;
+            }
 
-                symbol_type = FunctionSymbol;
+            if (platform)
+            {
+                view->CreateUserFunction(platform, offset);
             }
 
-            Ref<Symbol> symbol = new Symbol(symbol_type, name, offset);
+            Ref<Symbol> symbol = new Symbol(symbol_type, entry.source->name, offset);
 
             view->DefineUserSymbol(symbol);
             // view->DefineDataVariable(offset, Type::VoidType()->WithConfidence(0));
         }
-        catch (const std::exception& ex)
-        {
-            BinjaLog(ErrorLog, "Error parsing pattern file \"{}\": {}", file_name, ex.what());
-        }
-        catch (...)
-        {
-            BinjaLog(ErrorLog, "Error parsing pattern file \"{}\"", file_name);
-        }
+    }
 
-        return true;
-    });
+    StoreLoad(view, load_key, data ? data->content_hash() : 0, entries);
 
-    const auto total_end_time = stopwatch::now();
+    view->UpdateAnalysis();
 
-    const auto elapsed_ms =
-        std::chrono::duration_cast<std::chrono::milliseconds>(total_end_time - total_start_time).count();
+    const auto total_end_time = stopwatch::now();
 
-    BinjaLog(InfoLog, "Found {} patterns in {} ms ({} ms avg)\n", patterns.size(), elapsed_ms,
-        (double) elapsed_ms / (double) patterns.size());
+    const auto compile_ms =
+        std::chrono::duration_cast<std::chrono::milliseconds>(compile_end_time - total_start_time).count();
+    const auto scan_ms =
+        std::chrono::duration_cast<std::chrono::milliseconds>(apply_start_time - compile_end_time).count();
+    const auto apply_ms =
+        std::chrono::duration_cast<std::chrono::milliseconds>(total_end_time - apply_start_time).count();
+
+    BinjaLog(InfoLog,
+        "Loaded {} patterns in {} ms{}, scanned in {} ms ({} ms avg, {} reused), applied {} in {} ms ({} removed)\n",
+        entries.size(), compile_ms, from_cache ? " (cached)" : "", scan_ms, (double) scan_ms / (double) entries.size(),
+        reused_count, found_count, apply_ms, removed_count);
 }
 
 void LoadPatternFile(Ref<BinaryView> view)
@@ -18,11 +18,20 @@
 */
 
 #include "PatternMaker.h"
+#include "BackgroundTaskThread.h"
+#include "SimdScanner.h"
+#include "ViewCache.h"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
 
 #include <mem/data_buffer.h>
 #include <mem/pattern.h>
 #include <mem/utils.h>
 
+#include <yaml-cpp/yaml.h>
+
 #include <Zydis/Zydis.h>
 
 #if defined(_WIN32)
@@ -73,22 +82,83 @@ struct InstructionMaskDecoder
 {
     virtual ~InstructionMaskDecoder() = default;
     virtual size_t Decode(uint64_t address, const uint8_t* data, size_t length, uint8_t* masks) = 0;
+
+    // Finds the signed 32-bit field of the instruction at address which is relative to target.
+    // target == address + field_offset + value + field_adjust
+    virtual bool FindRelativeField(uint64_t /*address*/, const uint8_t* /*data*/, size_t /*length*/,
+        uint64_t /*target*/, size_t& /*field_offset*/, size_t& /*field_adjust*/)
+    {
+        return false;
+    }
 };
 
 struct X86MaskDecoder : InstructionMaskDecoder
 {
     ZydisDecoder Decoder;
+    bool Is64Bit {false};
 
     X86MaskDecoder(size_t address_width)
     {
         switch (address_width)
         {
             case 4: ZydisDecoderInit(&Decoder, ZYDIS_MACHINE_MODE_LONG_COMPAT_32, ZYDIS_ADDRESS_WIDTH_32); break;
-            case 8: ZydisDecoderInit(&Decoder, ZYDIS_MACHINE_MODE_LONG_64, ZYDIS_ADDRESS_WIDTH_64); break;
+            case 8:
+                ZydisDecoderInit(&Decoder, ZYDIS_MACHINE_MODE_LONG_64, ZYDIS_ADDRESS_WIDTH_64);
+                Is64Bit = true;
+                break;
             default: throw std::runtime_error("Invalid x86 Address Width");
         }
     }
 
+    bool FindRelativeField(uint64_t address, const uint8_t* data, size_t length, uint64_t target,
+        size_t& field_offset, size_t& field_adjust) override
+    {
+        ZydisDecodedInstruction insn;
+
+        if (ZYAN_FAILED(ZydisDecoderDecodeBuffer(&Decoder, data, length, &insn)))
+        {
+            return false;
+        }
+
+        const auto check = [&](size_t offset) {
+            int32_t value;
+            std::memcpy(&value, data + offset, sizeof(value));
+
+            // Relative to the end of the instruction
+            if (address + insn.length + static_cast<int64_t>(value) != target)
+            {
+                return false;
+            }
+
+            field_offset = offset;
+            field_adjust = insn.length - offset;
+
+            return true;
+        };
+
+        // call/jmp rel32
+        for (size_t i = 0; i < 2; ++i)
+        {
+            auto& imm = insn.raw.imm[i];
+
+            if (imm.is_relative && (imm.size == 32) && check(imm.offset))
+            {
+                return true;
+            }
+        }
+
+        // [rip + disp32]
+        auto& disp = insn.raw.disp;
+
+        if (Is64Bit && (insn.attributes & ZYDIS_ATTRIB_HAS_MODRM) && (insn.raw.modrm.mod == 0) &&
+            (insn.raw.modrm.rm == 5) && (disp.size == 32) && check(disp.offset))
+        {
+            return true;
+        }
+
+        return false;
+    }
+
     size_t Decode(uint64_t address, const uint8_t* data, size_t length, uint8_t* masks) override
     {
         ZydisDecodedInstruction insn;
@@ -119,65 +189,153 @@ struct X86MaskDecoder : InstructionMaskDecoder
     }
 };
 
-void GenerateSignature(Ref<BinaryView> view, uint64_t addr)
+// Treats data as a sequence of pointers, without masking anything
+struct PointerMaskDecoder : InstructionMaskDecoder
 {
-    Ref<BasicBlock> block = view->GetRecentBasicBlockForAddress(addr);
+    size_t Width;
 
-    if (!block)
-    {
-        BinjaLog(ErrorLog, "Unknown Address");
+    PointerMaskDecoder(size_t width)
+        : Width(width)
+    {}
 
-        return;
+    size_t Decode(uint64_t /*address*/, const uint8_t* /*data*/, size_t length, uint8_t* /*masks*/) override
+    {
+        return (length >= Width) ? Width : 0;
     }
+};
 
-    Ref<Function> func = block->GetFunction();
-    Ref<Architecture> arch = func->GetArchitecture();
+// Above this many matches, a pattern is grown further before its matches are tracked
+constexpr const size_t max_signature_candidates = 0x10000;
 
-    std::string arch_name = arch->GetName();
+// Longest pattern worth generating
+constexpr const size_t max_signature_length = 256;
 
-    std::unique_ptr<InstructionMaskDecoder> decoder;
+// Shorter patterns aren't scanned for, since they match almost everywhere
+constexpr const size_t min_signature_length = 5;
+
+static std::unique_ptr<InstructionMaskDecoder> CreateMaskDecoder(Ref<Architecture> arch)
+{
+    std::string arch_name = arch->GetName();
 
     if (arch_name == "x86" || arch_name == "x86_64")
     {
-        decoder.reset(new X86MaskDecoder(arch->GetAddressSize()));
+        return std::unique_ptr<InstructionMaskDecoder>(new X86MaskDecoder(arch->GetAddressSize()));
     }
-    else
-    {
-        BinjaLog(ErrorLog, "Unknown architecture: {}", arch_name);
 
-        return;
+    return nullptr;
+}
+
+struct Signature
+{
+    std::string pattern;
+
+    // Expression turning the pattern's address into the address the signature is for
+    std::string ops;
+
+    size_t length {0};
+
+    // Number of fully known bytes
+    size_t known {0};
+
+    // Estimated positions per byte the scanner has to check the whole pattern at
+    double cost {0.0};
+};
+
+// A view the signature has to be unique in
+struct SignatureTarget
+{
+    Ref<BinaryView> view;
+    std::shared_ptr<const brick::view_data> data;
+    std::shared_ptr<const brick::gram_index> index;
+
+    // Where the signature should match, or UINT64_MAX if any single match will do
+    uint64_t addr {UINT64_MAX};
+
+    // Other addresses the pattern so far matches at. Only filled by a full scan once, after which each new
+    // instruction just removes the candidates which don't match it.
+    std::vector<uint64_t> candidates;
+    bool scanned {false};
+
+    SignatureTarget(Ref<BinaryView> view_, std::shared_ptr<const brick::view_data> data_,
+        std::shared_ptr<const brick::gram_index> index_, uint64_t addr_)
+        : view(view_)
+        , data(std::move(data_))
+        , index(std::move(index_))
+        , addr(addr_)
+    {}
+
+    bool unique() const
+    {
+        return scanned && (candidates.size() == ((addr == UINT64_MAX) ? 1 : 0));
     }
+};
+
+// Grows a pattern from the first target's address one instruction at a time, until it matches exactly once in every
+// target. Bytes which differ at the other targets' addresses are masked. Scans in parallel if asked to, otherwise on
+// the calling thread (e.g. when already running on every core).
+static bool MakeSignature(std::vector<SignatureTarget>& targets, InstructionMaskDecoder& decoder,
+    size_t max_insn_length, bool parallel, size_t max_length, Signature& result, std::string& error)
+{
+    const SignatureTarget& primary = targets.front();
 
-    mem::byte_buffer insn_buffer(arch->GetMaxInstructionLength());
-    mem::byte_buffer mask_buffer(arch->GetMaxInstructionLength());
+    mem::byte_buffer insn_buffer(max_insn_length);
+    mem::byte_buffer mask_buffer(max_insn_length);
+    mem::byte_buffer data_buffer(max_insn_length);
 
     mem::byte_buffer bytes;
     mem::byte_buffer masks;
 
-    brick::view_data scan_data(view);
-
-    uint64_t current_addr = addr;
+    uint64_t current_addr = primary.addr;
 
     while (true)
     {
-        size_t len = view->Read(insn_buffer.data(), current_addr, insn_buffer.size());
+        size_t len = primary.view->Read(insn_buffer.data(), current_addr, insn_buffer.size());
 
         if (len == 0)
         {
-            BinjaLog(ErrorLog, "Failed to read data : 0x{:X}", current_addr);
+            error = fmt::format("Failed to read data : 0x{:X}", current_addr);
 
-            break;
+            return false;
         }
 
         std::memset(mask_buffer.data(), 0xFF, len);
 
-        len = decoder->Decode(current_addr, insn_buffer.data(), len, mask_buffer.data());
+        len = decoder.Decode(current_addr, insn_buffer.data(), len, mask_buffer.data());
 
         if (len == 0)
         {
-            BinjaLog(ErrorLog, "Failed to decode instruction @ 0x{:X}", current_addr);
+            error = fmt::format("Failed to decode instruction @ 0x{:X}", current_addr);
 
-            break;
+            return false;
+        }
+
+        const size_t insn_offset = bytes.size();
+
+        for (size_t i = 1; i < targets.size(); ++i)
+        {
+            const SignatureTarget& target = targets[i];
+
+            if (target.addr == UINT64_MAX)
+            {
+                continue;
+            }
+
+            if (!target.data->read(target.addr + insn_offset, data_buffer.data(), len))
+            {
+                error = fmt::format("Failed to read data : 0x{:X} ({})", target.addr + insn_offset,
+                    target.view->GetFile()->GetFilename());
+
+                return false;
+            }
+
+            // Ignore anything which changed between versions
+            for (size_t j = 0; j < len; ++j)
+            {
+                if (data_buffer[j] != insn_buffer[j])
+                {
+                    mask_buffer[j] = 0x00;
+                }
+            }
         }
 
         bytes.append(insn_buffer.data(), len);
@@ -185,38 +343,597 @@ void GenerateSignature(Ref<BinaryView> view, uint64_t addr)
 
         mem::pattern pat(bytes.data(), masks.data(), bytes.size());
 
-        if (pat.size() >= 5)
-        {
-            bool found = false;
+        const auto check_target = [&](SignatureTarget& target) {
+            if (target.scanned)
+            {
+                std::vector<uint8_t> target_buffer(len);
+
+                // Only the new instruction needs checking, the rest already matched
+                const auto mismatch = [&](uint64_t candidate) {
+                    if (!target.data->read(candidate + insn_offset, target_buffer.data(), len))
+                    {
+                        return true;
+                    }
+
+                    for (size_t i = 0; i < len; ++i)
+                    {
+                        if ((target_buffer[i] ^ insn_buffer[i]) & mask_buffer[i])
+                        {
+                            return true;
+                        }
+                    }
 
-            scan_data(mem::default_scanner(pat), [&](uint64_t result) {
-                if (addr == result)
                     return false;
+                };
+
+                target.candidates.erase(
+                    std::remove_if(target.candidates.begin(), target.candidates.end(), mismatch),
+                    target.candidates.end());
+            }
+            else if (pat.size() >= min_signature_length)
+            {
+                const brick::view_data& scan_data = *target.data;
 
-                found = true;
+                brick::simd_scanner scanner(pat, &scan_data.histogram());
 
-                return true;
-            });
+                std::vector<uint64_t> results;
+
+                if (!target.index || !target.index->scan_all(scan_data.regions(), pat, scanner, results, parallel))
+                {
+                    results = parallel ? scan_data.scan_all_parallel(pat, scanner) : scan_data.scan_all(pat, scanner);
+                }
+
+                // Too vague to be worth tracking, try again with the next instruction
+                if (results.size() <= max_signature_candidates)
+                {
+                    results.erase(std::remove(results.begin(), results.end(), target.addr), results.end());
 
-            if (!found)
+                    target.candidates = std::move(results);
+                    target.scanned = true;
+                }
+            }
+
+            return true;
+        };
+
+        if (parallel && (targets.size() > 1))
+        {
+            parallel_for_each(targets.begin(), targets.end(), check_target);
+        }
+        else
+        {
+            for (SignatureTarget& target : targets)
             {
-                std::string pat_string = pat.to_string();
+                check_target(target);
+            }
+        }
 
-                CopyToClipboard(pat_string);
+        for (const SignatureTarget& target : targets)
+        {
+            if (target.scanned && (target.addr == UINT64_MAX) && target.candidates.empty())
+            {
+                error = fmt::format("No match left in {}", target.view->GetFile()->GetFilename());
 
-                BinjaLog(InfoLog, "Generated Pattern: \"{}\"", pat_string);
+                return false;
+            }
+        }
 
-                break;
+        if (std::all_of(targets.begin(), targets.end(), [](const SignatureTarget& target) { return target.unique(); }))
+        {
+            const brick::byte_histogram& histogram = primary.data->histogram();
+
+            result.pattern = pat.to_string();
+            result.length = pat.size();
+            result.known = static_cast<size_t>(std::count(masks.data(), masks.data() + masks.size(), 0xFF));
+            result.cost = brick::simd_scanner(pat, &histogram).estimate_hit_rate(histogram);
+
+            return true;
+        }
+
+        if (pat.size() > max_length)
+        {
+            error = "Pattern too long";
+
+            return false;
+        }
+
+        current_addr += len;
+    }
+}
+
+// Alternative places to start a signature, if the function's own first bytes aren't unique enough
+constexpr const size_t max_signature_starts = 4;
+constexpr const size_t max_signature_code_refs = 8;
+constexpr const size_t max_signature_data_refs = 4;
+
+// Signatures within this many bytes of each other are compared by how fast they scan instead
+constexpr const size_t signature_length_slack = 8;
+
+static bool IsBetterSignature(const Signature& lhs, const Signature& rhs)
+{
+    if (lhs.length + signature_length_slack < rhs.length)
+    {
+        return true;
+    }
+
+    if (rhs.length + signature_length_slack < lhs.length)
+    {
+        return false;
+    }
+
+    if (lhs.cost != rhs.cost)
+    {
+        return lhs.cost < rhs.cost;
+    }
+
+    if (lhs.length != rhs.length)
+    {
+        return lhs.length < rhs.length;
+    }
+
+    return lhs.known > rhs.known;
+}
+
+// Tries starting at the function itself, at its next few instructions, at code referencing it (through a relative
+// call/jmp or rip-relative operand), and at pointers to it. Returns the shortest unique signature (or the cheapest to
+// scan, among ones of similar length), with the ops needed to get back to addr.
+static bool FindSignature(Ref<BinaryView> view, const std::shared_ptr<const brick::view_data>& scan_data,
+    const std::shared_ptr<const brick::gram_index>& index, Ref<Architecture> arch, InstructionMaskDecoder& decoder,
+    bool parallel, uint64_t addr, Signature& best, std::string& error)
+{
+    const size_t max_insn_length = arch->GetMaxInstructionLength();
+
+    bool found = false;
+
+    const auto attempt = [&](InstructionMaskDecoder& start_decoder, uint64_t start, std::string ops) {
+        // Nothing which couldn't beat the best so far is worth finishing
+        const size_t max_length =
+            found ? std::min(best.length + signature_length_slack, max_signature_length) : max_signature_length;
+
+        Signature current;
+        std::string current_error;
+
+        std::vector<SignatureTarget> targets;
+
+        targets.emplace_back(view, scan_data, index, start);
+
+        if (!MakeSignature(targets, start_decoder, max_insn_length, parallel, max_length, current, current_error))
+        {
+            if (!found && error.empty())
+            {
+                error = std::move(current_error);
             }
+
+            return;
         }
 
-        if (pat.size() > 256)
+        current.ops = std::move(ops);
+
+        if (!found || IsBetterSignature(current, best))
         {
-            BinjaLog(ErrorLog, "Pattern too long");
+            best = std::move(current);
+            found = true;
+        }
+    };
+
+    attempt(decoder, addr, "");
+
+    // Nothing else could be much shorter, and each alternative costs another scan (of the whole view, if unindexed)
+    if (found && (best.length <= min_signature_length + signature_length_slack))
+    {
+        return true;
+    }
+
+    std::vector<uint8_t> buffer(max_insn_length);
+    std::vector<uint8_t> masks(max_insn_length);
+
+    uint64_t offset = 0;
+
+    for (size_t i = 0; i < max_signature_starts; ++i)
+    {
+        const size_t len = decoder.Decode(
+            addr + offset, buffer.data(), view->Read(buffer.data(), addr + offset, buffer.size()), masks.data());
 
+        if (len == 0)
+        {
             break;
         }
 
-        current_addr += len;
+        offset += len;
+
+        attempt(decoder, addr + offset, fmt::format("$-{:X}", offset));
+    }
+
+    std::vector<ReferenceSource> code_refs = view->GetCodeReferences(addr);
+
+    if (code_refs.size() > max_signature_code_refs)
+    {
+        code_refs.resize(max_signature_code_refs);
+    }
+
+    for (const ReferenceSource& ref : code_refs)
+    {
+        const size_t len = view->Read(buffer.data(), ref.addr, buffer.size());
+
+        size_t field_offset = 0;
+        size_t field_adjust = 0;
+
+        if ((ref.arch.GetPtr() == arch.GetPtr()) &&
+            decoder.FindRelativeField(ref.addr, buffer.data(), len, addr, field_offset, field_adjust))
+        {
+            attempt(decoder, ref.addr, fmt::format("[$+{:X}].r+{:X}", field_offset, field_adjust));
+        }
+    }
+
+    std::vector<uint64_t> data_refs = view->GetDataReferences(addr);
+
+    if (data_refs.size() > max_signature_data_refs)
+    {
+        data_refs.resize(max_signature_data_refs);
+    }
+
+    const size_t pointer_size = view->GetAddressSize();
+
+    if ((pointer_size == 4) || (pointer_size == 8))
+    {
+        PointerMaskDecoder pointer_decoder(pointer_size);
+
+        for (uint64_t ref : data_refs)
+        {
+            attempt(pointer_decoder, ref, (pointer_size == 8) ? "[$].q" : "[$].d");
+        }
     }
+
+    return found;
+}
+
+void GenerateSignature(Ref<BinaryView> view, uint64_t addr)
+{
+    Ref<BasicBlock> block = view->GetRecentBasicBlockForAddress(addr);
+
+    if (!block)
+    {
+        BinjaLog(ErrorLog, "Unknown Address");
+
+        return;
+    }
+
+    Ref<Function> func = block->GetFunction();
+    Ref<Architecture> arch = func->GetArchitecture();
+
+    std::unique_ptr<InstructionMaskDecoder> decoder = CreateMaskDecoder(arch);
+
+    if (!decoder)
+    {
+        BinjaLog(ErrorLog, "Unknown architecture: {}", arch->GetName());
+
+        return;
+    }
+
+    std::shared_ptr<const brick::view_data> scan_data = brick::get_view_data(view);
+    std::shared_ptr<const brick::gram_index> index = brick::get_gram_index(view, scan_data);
+
+    Signature signature;
+    std::string error;
+
+    if (!FindSignature(view, scan_data, index, arch, *decoder, true, addr, signature, error))
+    {
+        BinjaLog(ErrorLog, "{}", error);
+
+        return;
+    }
+
+    // Reported per MiB, since the raw rate is tiny
+    const double hits_per_mib = signature.cost * 1024 * 1024;
+
+    if (signature.ops.empty())
+    {
+        CopyToClipboard(signature.pattern);
+
+        BinjaLog(InfoLog, "Generated Pattern: \"{}\" (~{:.1f} checks/MiB)", signature.pattern, hits_per_mib);
+    }
+    else
+    {
+        CopyToClipboard(fmt::format("pattern: \"{}\"\nops: \"{}\"", signature.pattern, signature.ops));
+
+        BinjaLog(InfoLog, "Generated Pattern: \"{}\", Ops: \"{}\" (~{:.1f} checks/MiB)", signature.pattern,
+            signature.ops, hits_per_mib);
+    }
+}
+
+// Finds where the function named name is in view, if it has exactly one
+static uint64_t FindFunctionByName(Ref<BinaryView> view, const std::string& name)
+{
+    uint64_t result = UINT64_MAX;
+
+    for (const Ref<Symbol>& symbol : view->GetSymbolsByName(name))
+    {
+        if (symbol->GetType() != FunctionSymbol)
+        {
+            continue;
+        }
+
+        if (result != UINT64_MAX)
+        {
+            return UINT64_MAX;
+        }
+
+        result = symbol->GetAddress();
+    }
+
+    return result;
+}
+
+void GenerateCrossSignature(Ref<BinaryView> view, uint64_t addr)
+{
+    Ref<BasicBlock> block = view->GetRecentBasicBlockForAddress(addr);
+
+    if (!block)
+    {
+        BinjaLog(ErrorLog, "Unknown Address");
+
+        return;
+    }
+
+    Ref<Function> func = block->GetFunction();
+    Ref<Architecture> arch = func->GetArchitecture();
+
+    std::unique_ptr<InstructionMaskDecoder> decoder = CreateMaskDecoder(arch);
+
+    if (!decoder)
+    {
+        BinjaLog(ErrorLog, "Unknown architecture: {}", arch->GetName());
+
+        return;
+    }
+
+    std::vector<Ref<BinaryView>> others;
+
+    for (const Ref<BinaryView>& other : brick::get_open_views())
+    {
+        Ref<Architecture> other_arch = other->GetDefaultArchitecture();
+
+        if ((other->GetObject() != view->GetObject()) && other_arch && (other_arch->GetName() == arch->GetName()))
+        {
+            others.push_back(other);
+        }
+    }
+
+    if (others.empty())
+    {
+        BinjaLog(ErrorLog, "No other {} views are open", arch->GetName());
+
+        return;
+    }
+
+    std::vector<FormInputField> fields;
+
+    for (const Ref<BinaryView>& other : others)
+    {
+        FormInputField field = FormInputField::Choice(other->GetFile()->GetFilename(), {"Include", "Exclude"});
+
+        field.hasDefault = true;
+        field.indexDefault = 0;
+
+        fields.push_back(field);
+    }
+
+    if (!BinaryNinja::GetFormInput(fields, "Views to Match"))
+    {
+        return;
+    }
+
+    std::vector<SignatureTarget> targets;
+
+    {
+        std::shared_ptr<const brick::view_data> scan_data = brick::get_view_data(view);
+
+        targets.emplace_back(view, scan_data, brick::get_gram_index(view, scan_data), addr);
+    }
+
+    Ref<Symbol> symbol = func->GetSymbol();
+
+    for (size_t i = 0; i < others.size(); ++i)
+    {
+        if (fields[i].indexResult != 0)
+        {
+            continue;
+        }
+
+        Ref<BinaryView> other = others[i];
+
+        // Bytes can only be compared if the same function is known in the other view, otherwise it's enough for the
+        // signature to match once
+        const uint64_t other_addr = symbol ? FindFunctionByName(other, symbol->GetFullName()) : UINT64_MAX;
+
+        if (other_addr != UINT64_MAX)
+        {
+            BinjaLog(InfoLog, "Matching {} @ 0x{:X} in {}", symbol->GetFullName(), other_addr,
+                other->GetFile()->GetFilename());
+        }
+
+        std::shared_ptr<const brick::view_data> scan_data = brick::get_view_data(other);
+
+        targets.emplace_back(other, scan_data, brick::get_gram_index(other, scan_data), other_addr);
+    }
+
+    Signature signature;
+    std::string error;
+
+    if (!MakeSignature(
+            targets, *decoder, arch->GetMaxInstructionLength(), true, max_signature_length, signature, error))
+    {
+        BinjaLog(ErrorLog, "{}", error);
+
+        return;
+    }
+
+    CopyToClipboard(signature.pattern);
+
+    BinjaLog(InfoLog, "Generated Pattern: \"{}\" (unique in {} views, ~{:.1f} checks/MiB)", signature.pattern,
+        targets.size(), signature.cost * 1024 * 1024);
+}
+
+static void GenerateSignaturesTask(Ref<BackgroundTask> task, Ref<BinaryView> view,
+    std::vector<Ref<Function>> functions, std::string file_name)
+{
+    using stopwatch = std::chrono::steady_clock;
+
+    const auto start_time = stopwatch::now();
+
+    std::shared_ptr<const brick::view_data> scan_data = brick::get_view_data(view);
+    std::shared_ptr<const brick::gram_index> index = brick::get_gram_index(view, scan_data);
+
+    // Thousands of full scans cost far more than indexing the view once, unless indexing is disabled
+    if (!index && Settings::Instance()->Get<bool>("pattern.indexView", view))
+    {
+        task->SetProgressText("Generating Signatures: Indexing view");
+
+        index = std::make_shared<const brick::gram_index>(scan_data);
+    }
+
+    struct SignatureResult
+    {
+        std::string name;
+        Signature signature;
+        std::string error;
+    };
+
+    std::vector<SignatureResult> results(functions.size());
+    std::vector<size_t> indices(functions.size());
+
+    for (size_t i = 0; i < indices.size(); ++i)
+    {
+        indices[i] = i;
+    }
+
+    std::atomic_size_t completed {0};
+
+    // Each function is scanned on a single thread (FindSignature and the index are told not to spawn any more),
+    // with one function per core
+    parallel_for_each(indices.begin(), indices.end(), [&](size_t i) {
+        if (task->IsCancelled())
+        {
+            return false;
+        }
+
+        Ref<Function> func = functions[i];
+        Ref<Architecture> arch = func->GetArchitecture();
+        Ref<Symbol> symbol = func->GetSymbol();
+
+        SignatureResult& result = results[i];
+
+        result.name = symbol ? symbol->GetFullName() : fmt::format("sub_{:x}", func->GetStart());
+
+        if (std::unique_ptr<InstructionMaskDecoder> decoder = CreateMaskDecoder(arch))
+        {
+            FindSignature(
+                view, scan_data, index, arch, *decoder, false, func->GetStart(), result.signature, result.error);
+        }
+        else
+        {
+            result.error = fmt::format("Unknown architecture: {}", arch->GetName());
+        }
+
+        const size_t done = ++completed;
+
+        if ((done % 64) == 0)
+        {
+            task->SetProgressText(fmt::format("Generating Signatures: {} / {}", done, functions.size()));
+        }
+
+        return true;
+    });
+
+    if (task->IsCancelled())
+    {
+        return;
+    }
+
+    YAML::Emitter output;
+
+    output << YAML::BeginMap << YAML::Key << "patterns" << YAML::Value << YAML::BeginSeq;
+
+    size_t failed = 0;
+
+    for (const SignatureResult& result : results)
+    {
+        if (result.signature.pattern.empty())
+        {
+            BinjaLog(WarningLog, "{}: {}", result.name, result.error);
+
+            ++failed;
+
+            continue;
+        }
+
+        output << YAML::BeginMap;
+        output << YAML::Key << "name" << YAML::Value << result.name;
+        output << YAML::Key << "category" << YAML::Value << "Function";
+        output << YAML::Key << "pattern" << YAML::Value << YAML::DoubleQuoted << result.signature.pattern;
+
+        if (!result.signature.ops.empty())
+        {
+            output << YAML::Key << "ops" << YAML::Value << YAML::DoubleQuoted << result.signature.ops;
+        }
+
+        output << YAML::EndMap;
+    }
+
+    output << YAML::EndSeq << YAML::EndMap;
+
+    std::ofstream file(file_name, std::ios::trunc);
+
+    if (!(file << output.c_str() << std::endl))
+    {
+        BinjaLog(ErrorLog, "Failed to write \"{}\"", file_name);
+
+        return;
+    }
+
+    const auto elapsed_ms =
+        std::chrono::duration_cast<std::chrono::milliseconds>(stopwatch::now() - start_time).count();
+
+    BinjaLog(InfoLog, "Generated {} signatures ({} failed) in {} ms ({:.1f} functions/s)",
+        results.size() - failed, failed, elapsed_ms,
+        (double) results.size() * 1000.0 / (double) std::max<int64_t>(elapsed_ms, 1));
+}
+
+static void GenerateSignatures(Ref<BinaryView> view, std::vector<Ref<Function>> functions)
+{
+    if (functions.empty())
+    {
+        BinjaLog(ErrorLog, "No functions selected");
+
+        return;
+    }
+
+    std::string output_file;
+
+    if (BinaryNinja::GetSaveFileNameInput(output_file, "Save Pattern File", "*.yml;*.yaml"))
+    {
+        Ref<BackgroundTaskThread> task = new BackgroundTaskThread("Generating Signatures");
+
+        task->Run(&GenerateSignaturesTask, view, std::move(functions), output_file);
+    }
+}
+
+void GenerateAllSignatures(Ref<BinaryView> view)
+{
+    GenerateSignatures(view, view->GetAnalysisFunctionList());
+}
+
+void GenerateRangeSignatures(Ref<BinaryView> view, uint64_t addr, uint64_t len)
+{
+    std::vector<Ref<Function>> functions;
+
+    for (const Ref<Function>& func : view->GetAnalysisFunctionList())
+    {
+        if ((func->GetStart() >= addr) && (func->GetStart() - addr < len))
+        {
+            functions.push_back(func);
+        }
+    }
+
+    GenerateSignatures(view, std::move(functions));
 }
@@ -18,6 +18,9 @@
 */
 
 #include "PatternScanner.h"
+#include "SimdScanner.h"
+#include "ViewCache.h"
+#include "ViewStream.h"
 
 #include <mem/pattern.h>
 #include <mem/utils.h>
@@ -101,8 +104,8 @@ std::string HtmlEncode(const std::string& data)
     return buffer;
 }
 
-void ScanForArrayOfBytesInternal(
-    Ref<BackgroundTask> task, Ref<BinaryView> view, const mem::pattern& pattern, const std::string& pattern_string)
+void ScanForArrayOfBytesInternal(Ref<BackgroundTask> task, Ref<BinaryView> view, const mem::pattern& pattern,
+    const std::string& pattern_string, const brick::scan_scope& scope)
 {
     using stopwatch = std::chrono::steady_clock;
 
@@ -113,8 +116,6 @@ void ScanForArrayOfBytesInternal(
         return;
     }
 
-    mem::default_scanner scanner(pattern);
-
     std::vector<uint64_t> results;
 
     size_t total_size {0};
@@ -122,7 +123,24 @@ void ScanForArrayOfBytesInternal(
 
     const auto total_start_time = stopwatch::now();
 
-    brick::view_data view_data(view);
+    const std::vector<brick::address_range> ranges = scope.resolve(view);
+
+    // Views too large to keep in memory are read a chunk at a time instead
+    const bool streaming = brick::should_stream(view);
+
+    std::shared_ptr<const brick::view_data> view_data;
+    std::shared_ptr<const brick::gram_index> index;
+    std::vector<brick::view_region> regions;
+
+    if (!streaming)
+    {
+        view_data = brick::get_view_data(view);
+        index = brick::get_gram_index(view, view_data);
+        regions = view_data->regions(ranges);
+    }
+
+    // Anchor on the bytes which are rarest in this view, when it has been read
+    brick::simd_scanner scanner(pattern, view_data ? &view_data->histogram() : nullptr);
 
     for (size_t i = 0; i < SCAN_RUNS; ++i)
     {
@@ -135,13 +153,22 @@ void ScanForArrayOfBytesInternal(
 
         const auto start_time = stopwatch::now();
 
-        std::vector<uint64_t> sub_results = view_data.scan_all(scanner);
+        std::vector<uint64_t> sub_results;
+
+        if (streaming)
+        {
+            sub_results = brick::stream_scan_all(view, ranges, pattern, scanner);
+        }
+        else if (!index || !index->scan_all(regions, pattern, scanner, sub_results, true))
+        {
+            sub_results = view_data->scan_all_parallel(regions, pattern, scanner);
+        }
 
         const auto end_time = stopwatch::now();
 
-        for (const auto& seg : view_data.segments)
+        for (const auto& range : ranges)
         {
-            total_size += seg.length;
+            total_size += range.end - range.start;
         }
 
         elapsed_ms += std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time).count();
@@ -231,14 +258,23 @@ void ScanForArrayOfBytesInternal(
     view->ShowHTMLReport("Scan Results", report, "");
 }
 
-void ScanForArrayOfBytesTask(
-    Ref<BackgroundTask> task, Ref<BinaryView> view, std::string pattern_string, std::string mask_string)
+void ScanForArrayOfBytesTask(Ref<BackgroundTask> task, Ref<BinaryView> view, std::string pattern_string,
+    std::string mask_string, std::string scope_string)
 {
+    brick::scan_scope scope;
+
+    if (!scope.parse(scope_string))
+    {
+        BinjaLog(ErrorLog, "Invalid scope \"{}\"", scope_string);
+
+        return;
+    }
+
     if (mask_string.empty())
     {
         mem::pattern pattern(pattern_string.c_str());
 
-        ScanForArrayOfBytesInternal(task, view, pattern, pattern_string);
+        ScanForArrayOfBytesInternal(task, view, pattern, pattern_string, scope);
     }
     else
     {
@@ -254,7 +290,7 @@ void ScanForArrayOfBytesTask(
 
         mem::pattern pattern(pattern_bytes.data(), mask_string.c_str());
 
-        ScanForArrayOfBytesInternal(task, view, pattern, pattern_string + ", " + mask_string);
+        ScanForArrayOfBytesInternal(task, view, pattern, pattern_string + ", " + mask_string, scope);
     }
 }
 
@@ -264,15 +300,17 @@ void ScanForArrayOfBytes(Ref<BinaryView> view)
 
     fields.push_back(FormInputField::TextLine("Pattern"));
     fields.push_back(FormInputField::TextLine("Mask (Optional)"));
+    fields.push_back(FormInputField::TextLine("Scope (Optional, e.g. \"executable, .rdata, 0x1000-0x2000\")"));
 
     if (BinaryNinja::GetFormInput(fields, "Input Pattern"))
     {
-        std::string pattern_string = fields[0].stringResult, mask_string = fields[1].stringResult;
+        std::string pattern_string = fields[0].stringResult, mask_string = fields[1].stringResult,
+                    scope_string = fields[2].stringResult;
 
         Ref<BackgroundTaskThread> task =
             new BackgroundTaskThread(fmt::format("Scanning for pattern: \"{}\"", pattern_string));
 
-        task->Run(ScanForArrayOfBytesTask, view, pattern_string, mask_string);
+        task->Run(ScanForArrayOfBytesTask, view, pattern_string, mask_string, scope_string);
     }
 }
 
@@ -281,7 +319,7 @@ extern "C"
     struct BinaryPattern
     {
         mem::pattern Pattern {};
-        mem::default_scanner Scanner {};
+        brick::simd_scanner Scanner {};
     };
 
     BINARYNINJAPLUGIN BinaryPattern* BinaryPattern_Parse(const char* pattern)
@@ -289,7 +327,7 @@ extern "C"
         BinaryPattern* result = new BinaryPattern();
 
         result->Pattern = mem::pattern(pattern);
-        result->Scanner = mem::default_scanner(result->Pattern);
+        result->Scanner = brick::simd_scanner(result->Pattern);
 
         return result;
     }
@@ -314,4 +352,46 @@ extern "C"
 
         return total;
     }
+
+    BINARYNINJAPLUGIN size_t BinaryPattern_ScanView(
+        BinaryPattern* pattern, BNBinaryView* view_handle, const char* scope_string, uint64_t* values, size_t limit)
+    {
+        if (limit == 0)
+            return 0;
+
+        brick::scan_scope scope;
+
+        if (scope_string && !scope.parse(scope_string))
+            return 0;
+
+        Ref<BinaryView> view = new BinaryView(BNNewViewReference(view_handle));
+
+        const std::vector<brick::address_range> ranges = scope.resolve(view);
+
+        size_t total = 0;
+
+        const auto callback = [values, limit, &total](uint64_t addr) {
+            values[total++] = addr;
+            return total == limit;
+        };
+
+        if (brick::should_stream(view))
+        {
+            const size_t overlap = (pattern->Pattern.size() != 0) ? (pattern->Pattern.size() - 1) : 0;
+
+            brick::stream_view(view, ranges, static_cast<size_t>(brick::get_scan_memory_limit(view) / 2), overlap,
+                [&](const brick::view_region& region, size_t /*carry_length*/) {
+                    return !brick::view_data::scan_region(region, pattern->Pattern, pattern->Scanner, callback);
+                });
+        }
+        else
+        {
+            std::shared_ptr<const brick::view_data> view_data = brick::get_view_data(view);
+
+            (*view_data)(view_data->regions(ranges), pattern->Pattern,
+                brick::simd_scanner(pattern->Pattern, &view_data->histogram()), callback);
+        }
+
+        return total;
+    }
 }
@@ -0,0 +1,510 @@
+/*
+    Copyright 2018 Brick
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+    and associated documentation files (the "Software"), to deal in the Software without restriction,
+    including without limitation the rights to use, copy, modify, merge, publish, distribute,
+    sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all copies or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+    BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "SimdScanner.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#    define BRICK_SIMD_X86
+#    include <immintrin.h>
+#    if defined(_MSC_VER) && !defined(__clang__)
+#        include <intrin.h>
+#        define BRICK_TARGET(features)
+#    else
+#        define BRICK_TARGET(features) __attribute__((target(features)))
+#    endif
+#endif
+
+namespace brick
+{
+    // Bytes which are common in typical x86 executables, most common first.
+    // Anchoring on any other byte is preferred.
+    static const uint8_t common_bytes[] {
+        0x00, 0xFF, 0xCC, 0x48, 0x8B, 0x89, 0x24, 0x0F, 0x01, 0x4C, 0x44, 0xE8, 0x83, 0x8D, 0x85, 0x08,
+        0x10, 0x45, 0xC3, 0x20, 0x74, 0x75, 0x40, 0xC0, 0x04, 0x02, 0x03, 0x49, 0x41, 0x90, 0x50, 0x30,
+    };
+
+    byte_histogram::byte_histogram()
+        : bytes(0x100, 0)
+        , pairs(0x10000, 0)
+    {}
+
+    void byte_histogram::add(const uint8_t* data, size_t length)
+    {
+        if (length == 0)
+        {
+            return;
+        }
+
+        total += length;
+
+        for (size_t i = 0; i + 1 < length; ++i)
+        {
+            ++bytes[data[i]];
+            ++pairs[data[i] | (size_t(data[i + 1]) << 8)];
+        }
+
+        ++bytes[data[length - 1]];
+    }
+
+    void byte_histogram::add_zeros(uint64_t length)
+    {
+        if (length == 0)
+        {
+            return;
+        }
+
+        total += length;
+        bytes[0] += length;
+        pairs[0] += length - 1;
+    }
+
+    void byte_histogram::merge(const byte_histogram& other)
+    {
+        total += other.total;
+
+        for (size_t i = 0; i < bytes.size(); ++i)
+        {
+            bytes[i] += other.bytes[i];
+        }
+
+        for (size_t i = 0; i < pairs.size(); ++i)
+        {
+            pairs[i] += other.pairs[i];
+        }
+    }
+
+    double byte_histogram::estimate(uint8_t first, uint8_t second, size_t distance) const
+    {
+        if (distance == 1)
+        {
+            return static_cast<double>(pair(first, second));
+        }
+
+        if (total == 0)
+        {
+            return 0.0;
+        }
+
+        // Assume bytes further apart are independent
+        return static_cast<double>(bytes[first]) * static_cast<double>(bytes[second]) / static_cast<double>(total);
+    }
+
+    static byte_histogram make_typical_byte_histogram()
+    {
+        byte_histogram result;
+
+        for (size_t i = 0; i < 0x100; ++i)
+        {
+            result.bytes[i] = 1;
+        }
+
+        for (size_t i = 0; i < sizeof(common_bytes); ++i)
+        {
+            result.bytes[common_bytes[i]] = 2 * (sizeof(common_bytes) - i) + 1;
+        }
+
+        for (size_t i = 0; i < 0x100; ++i)
+        {
+            result.total += result.bytes[i];
+        }
+
+        for (size_t i = 0; i < 0x10000; ++i)
+        {
+            result.pairs[i] = result.bytes[i & 0xFF] * result.bytes[i >> 8];
+        }
+
+        return result;
+    }
+
+    const byte_histogram& typical_byte_histogram()
+    {
+        static const byte_histogram histogram = make_typical_byte_histogram();
+
+        return histogram;
+    }
+
+    simd_scanner::simd_scanner(const mem::pattern& pattern, const byte_histogram* histogram, simd_level level)
+        : bytes_(pattern.bytes(), pattern.bytes() + pattern.size())
+        , masks_(pattern.masks(), pattern.masks() + pattern.size())
+        , level_(std::min(level, supported_simd_level()))
+    {
+        for (size_t i = 0; i < bytes_.size(); ++i)
+        {
+            bytes_[i] &= masks_[i];
+        }
+
+        if (!histogram)
+        {
+            histogram = &typical_byte_histogram();
+        }
+
+        std::vector<size_t> known;
+
+        for (size_t i = 0; i < bytes_.size(); ++i)
+        {
+            if (masks_[i] == 0xFF)
+            {
+                known.push_back(i);
+            }
+        }
+
+        if (known.empty())
+        {
+            return;
+        }
+
+        anchored_ = true;
+
+        const auto byte_count = [&](size_t i) { return histogram->bytes[bytes_[i]]; };
+
+        anchors_[0] = anchors_[1] = known[0];
+
+        for (size_t i : known)
+        {
+            if (byte_count(i) < byte_count(anchors_[0]))
+            {
+                anchors_[0] = anchors_[1] = i;
+            }
+        }
+
+        // Prefer the pair of known bytes least likely to occur together
+        double best_estimate = 0.0;
+        bool paired = false;
+
+        for (size_t i = 0; i < known.size(); ++i)
+        {
+            for (size_t j = i + 1; j < known.size(); ++j)
+            {
+                const size_t first = known[i];
+                const size_t second = known[j];
+
+                const double estimate = histogram->estimate(bytes_[first], bytes_[second], second - first);
+
+                if (!paired || (estimate < best_estimate))
+                {
+                    paired = true;
+                    best_estimate = estimate;
+
+                    // The scalar fallback only checks the first anchor, so make it the rarer one
+                    const bool swap = byte_count(second) < byte_count(first);
+
+                    anchors_[0] = swap ? second : first;
+                    anchors_[1] = swap ? first : second;
+                }
+            }
+        }
+    }
+
+    bool simd_scanner::verify(const uint8_t* data) const
+    {
+        const uint8_t* bytes = bytes_.data();
+        const uint8_t* masks = masks_.data();
+
+        for (size_t i = 0, size = bytes_.size(); i < size; ++i)
+        {
+            if ((data[i] & masks[i]) != bytes[i])
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    double simd_scanner::estimate_hit_rate(const byte_histogram& histogram) const
+    {
+        if (!anchored_)
+        {
+            return 1.0;
+        }
+
+        if (histogram.total == 0)
+        {
+            return 0.0;
+        }
+
+        const double total = static_cast<double>(histogram.total);
+
+        if (anchors_[0] == anchors_[1])
+        {
+            return static_cast<double>(histogram.bytes[bytes_[anchors_[0]]]) / total;
+        }
+
+        const size_t first = std::min(anchors_[0], anchors_[1]);
+        const size_t second = std::max(anchors_[0], anchors_[1]);
+
+        return histogram.estimate(bytes_[first], bytes_[second], second - first) / total;
+    }
+
+    static const uint8_t* find_scalar(const simd_scanner& scanner, const uint8_t* begin, const uint8_t* end)
+    {
+        if (!scanner.anchored())
+        {
+            for (; begin < end; ++begin)
+            {
+                if (scanner.verify(begin))
+                {
+                    return begin;
+                }
+            }
+
+            return nullptr;
+        }
+
+        const size_t anchor = scanner.anchors()[0];
+        const uint8_t value = scanner.bytes()[anchor];
+
+        while (begin < end)
+        {
+            const void* hit = std::memchr(begin + anchor, value, static_cast<size_t>(end - begin));
+
+            if (!hit)
+            {
+                break;
+            }
+
+            const uint8_t* candidate = static_cast<const uint8_t*>(hit) - anchor;
+
+            if (scanner.verify(candidate))
+            {
+                return candidate;
+            }
+
+            begin = candidate + 1;
+        }
+
+        return nullptr;
+    }
+
+#if defined(BRICK_SIMD_X86)
+    static inline unsigned count_trailing_zeros(uint32_t value)
+    {
+#    if defined(_MSC_VER) && !defined(__clang__)
+        unsigned long index;
+        _BitScanForward(&index, value);
+        return index;
+#    else
+        return static_cast<unsigned>(__builtin_ctz(value));
+#    endif
+    }
+
+    static inline unsigned count_trailing_zeros(uint64_t value)
+    {
+#    if defined(_MSC_VER) && !defined(__clang__)
+#        if defined(_M_X64)
+        unsigned long index;
+        _BitScanForward64(&index, value);
+        return index;
+#        else
+        const uint32_t low = static_cast<uint32_t>(value);
+        return low ? count_trailing_zeros(low) : (32 + count_trailing_zeros(static_cast<uint32_t>(value >> 32)));
+#        endif
+#    else
+        return static_cast<unsigned>(__builtin_ctzll(value));
+#    endif
+    }
+
+    BRICK_TARGET("sse2")
+    static const uint8_t* find_sse2(const simd_scanner& scanner, const uint8_t* begin, const uint8_t* end)
+    {
+        const size_t anchor0 = scanner.anchors()[0];
+        const size_t anchor1 = scanner.anchors()[1];
+
+        const __m128i value0 = _mm_set1_epi8(static_cast<char>(scanner.bytes()[anchor0]));
+        const __m128i value1 = _mm_set1_epi8(static_cast<char>(scanner.bytes()[anchor1]));
+
+        for (; end - begin >= 16; begin += 16)
+        {
+            const __m128i match0 =
+                _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(begin + anchor0)), value0);
+            const __m128i match1 =
+                _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(begin + anchor1)), value1);
+
+            for (uint32_t bits = static_cast<uint32_t>(_mm_movemask_epi8(_mm_and_si128(match0, match1))); bits;
+                 bits &= bits - 1)
+            {
+                const uint8_t* candidate = begin + count_trailing_zeros(bits);
+
+                if (scanner.verify(candidate))
+                {
+                    return candidate;
+                }
+            }
+        }
+
+        return find_scalar(scanner, begin, end);
+    }
+
+    BRICK_TARGET("avx2")
+    static const uint8_t* find_avx2(const simd_scanner& scanner, const uint8_t* begin, const uint8_t* end)
+    {
+        const size_t anchor0 = scanner.anchors()[0];
+        const size_t anchor1 = scanner.anchors()[1];
+
+        const __m256i value0 = _mm256_set1_epi8(static_cast<char>(scanner.bytes()[anchor0]));
+        const __m256i value1 = _mm256_set1_epi8(static_cast<char>(scanner.bytes()[anchor1]));
+
+        for (; end - begin >= 32; begin += 32)
+        {
+            const __m256i match0 =
+                _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin + anchor0)), value0);
+            const __m256i match1 =
+                _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin + anchor1)), value1);
+
+            for (uint32_t bits = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(match0, match1)));
+                 bits; bits &= bits - 1)
+            {
+                const uint8_t* candidate = begin + count_trailing_zeros(bits);
+
+                if (scanner.verify(candidate))
+                {
+                    return candidate;
+                }
+            }
+        }
+
+        return find_scalar(scanner, begin, end);
+    }
+
+    BRICK_TARGET("avx512f,avx512bw")
+    static const uint8_t* find_avx512(const simd_scanner& scanner, const uint8_t* begin, const uint8_t* end)
+    {
+        const size_t anchor0 = scanner.anchors()[0];
+        const size_t anchor1 = scanner.anchors()[1];
+
+        const __m512i value0 = _mm512_set1_epi8(static_cast<char>(scanner.bytes()[anchor0]));
+        const __m512i value1 = _mm512_set1_epi8(static_cast<char>(scanner.bytes()[anchor1]));
+
+        for (; end - begin >= 64; begin += 64)
+        {
+            const __mmask64 match0 = _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(begin + anchor0), value0);
+            const __mmask64 match1 = _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(begin + anchor1), value1);
+
+            for (uint64_t bits = static_cast<uint64_t>(match0 & match1); bits; bits &= bits - 1)
+            {
+                const uint8_t* candidate = begin + count_trailing_zeros(bits);
+
+                if (scanner.verify(candidate))
+                {
+                    return candidate;
+                }
+            }
+        }
+
+        return find_scalar(scanner, begin, end);
+    }
+#endif
+
+    static simd_level detect_simd_level()
+    {
+#if defined(BRICK_SIMD_X86)
+#    if defined(_MSC_VER) && !defined(__clang__)
+        int info[4];
+
+        __cpuid(info, 0);
+
+        const int max_leaf = info[0];
+
+        __cpuid(info, 1);
+
+        const bool has_sse2 = (info[3] & (1 << 26)) != 0;
+        const bool has_avx = ((info[2] & (1 << 27)) != 0) && ((info[2] & (1 << 28)) != 0);
+
+        // Check the OS saves the YMM/ZMM registers
+        const uint64_t xcr0 = has_avx ? _xgetbv(0) : 0;
+
+        bool has_avx2 = false;
+        bool has_avx512bw = false;
+
+        if (max_leaf >= 7)
+        {
+            __cpuidex(info, 7, 0);
+
+            has_avx2 = has_avx && ((info[1] & (1 << 5)) != 0) && ((xcr0 & 0x06) == 0x06);
+            has_avx512bw = has_avx2 && ((info[1] & (1 << 16)) != 0) && ((info[1] & (1 << 30)) != 0) &&
+                ((xcr0 & 0xE6) == 0xE6);
+        }
+#    else
+        __builtin_cpu_init();
+
+        const bool has_sse2 = __builtin_cpu_supports("sse2");
+        const bool has_avx2 = __builtin_cpu_supports("avx2");
+        const bool has_avx512bw = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#    endif
+
+        if (has_avx512bw)
+        {
+            return simd_level::avx512;
+        }
+
+        if (has_avx2)
+        {
+            return simd_level::avx2;
+        }
+
+        if (has_sse2)
+        {
+            return simd_level::sse2;
+        }
+#endif
+
+        return simd_level::scalar;
+    }
+
+    simd_level supported_simd_level()
+    {
+        static const simd_level level = detect_simd_level();
+
+        return level;
+    }
+
+    const char* to_string(simd_level level)
+    {
+        switch (level)
+        {
+            case simd_level::scalar: return "scalar";
+            case simd_level::sse2: return "sse2";
+            case simd_level::avx2: return "avx2";
+            case simd_level::avx512: return "avx512";
+        }
+
+        return "unknown";
+    }
+
+    const uint8_t* simd_scanner::find(const uint8_t* begin, const uint8_t* end) const
+    {
+        if (anchored_)
+        {
+            switch (level_)
+            {
+#if defined(BRICK_SIMD_X86)
+                case simd_level::avx512: return find_avx512(*this, begin, end);
+                case simd_level::avx2: return find_avx2(*this, begin, end);
+                case simd_level::sse2: return find_sse2(*this, begin, end);
+#endif
+                default: break;
+            }
+        }
+
+        return find_scalar(*this, begin, end);
+    }
+} // namespace brick
@@ -0,0 +1,350 @@
+/*
+    Copyright 2018 Brick
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+    and associated documentation files (the "Software"), to deal in the Software without restriction,
+    including without limitation the rights to use, copy, modify, merge, publish, distribute,
+    sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all copies or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+    BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "ViewCache.h"
+#include "BackgroundTaskThread.h"
+#include "ViewDiskCache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+
+namespace brick
+{
+    struct view_cache_entry;
+
+    class view_cache_notification : public BinaryDataNotification
+    {
+    private:
+        view_cache_entry& entry_;
+
+    public:
+        view_cache_notification(view_cache_entry& entry)
+            : entry_(entry)
+        {}
+
+        void OnBinaryDataWritten(BinaryView* view, uint64_t offset, size_t len) override;
+        void OnBinaryDataInserted(BinaryView* view, uint64_t offset, size_t len) override;
+        void OnBinaryDataRemoved(BinaryView* view, uint64_t offset, uint64_t len) override;
+
+        void OnSegmentAdded(BinaryView* view, Segment* segment) override;
+        void OnSegmentRemoved(BinaryView* view, Segment* segment) override;
+        void OnSegmentUpdated(BinaryView* view, Segment* segment) override;
+    };
+
+    // Compact the pending ranges once there are this many, so a long editing session doesn't grow them forever
+    constexpr const size_t max_dirty_ranges = 4096;
+
+    // Keyed by the raw view, and doesn't reference it, so closing the view is what releases the entry
+    struct view_cache_entry
+    {
+        view_cache_notification notification;
+
+        // Serializes refreshing the snapshot, so concurrent callers only read the view once
+        std::mutex build_lock;
+
+        // Protects data and dirty
+        std::mutex data_lock;
+        std::shared_ptr<const view_data> data;
+
+        // Page aligned ranges changed since data was read
+        std::vector<address_range> dirty;
+
+        // Index of the latest snapshot, if finished, and the snapshot currently being indexed
+        std::shared_ptr<const gram_index> index;
+        std::shared_ptr<const view_data> indexing;
+
+        view_cache_entry()
+            : notification(*this)
+        {}
+
+        void mark_dirty(uint64_t start, uint64_t end)
+        {
+            start &= ~(view_page_size - 1);
+            end = (end > UINT64_MAX - (view_page_size - 1)) ? UINT64_MAX
+                                                              : ((end + (view_page_size - 1)) & ~(view_page_size - 1));
+
+            std::lock_guard<std::mutex> guard(data_lock);
+
+            dirty.push_back({start, end});
+
+            if (dirty.size() >= max_dirty_ranges)
+            {
+                merge_ranges(dirty);
+            }
+        }
+    };
+
+    void view_cache_notification::OnBinaryDataWritten(BinaryView* /*view*/, uint64_t offset, size_t len)
+    {
+        entry_.mark_dirty(offset, offset + len);
+    }
+
+    // Inserting or removing data moves everything after it
+
+    void view_cache_notification::OnBinaryDataInserted(BinaryView* /*view*/, uint64_t offset, size_t /*len*/)
+    {
+        entry_.mark_dirty(offset, UINT64_MAX);
+    }
+
+    void view_cache_notification::OnBinaryDataRemoved(BinaryView* /*view*/, uint64_t offset, uint64_t /*len*/)
+    {
+        entry_.mark_dirty(offset, UINT64_MAX);
+    }
+
+    void view_cache_notification::OnSegmentAdded(BinaryView* /*view*/, Segment* segment)
+    {
+        entry_.mark_dirty(segment->GetStart(), segment->GetEnd());
+    }
+
+    void view_cache_notification::OnSegmentRemoved(BinaryView* /*view*/, Segment* segment)
+    {
+        entry_.mark_dirty(segment->GetStart(), segment->GetEnd());
+    }
+
+    void view_cache_notification::OnSegmentUpdated(BinaryView* /*view*/, Segment* segment)
+    {
+        entry_.mark_dirty(segment->GetStart(), segment->GetEnd());
+    }
+
+    static std::mutex view_cache_lock;
+    static std::unordered_map<BNBinaryView*, std::shared_ptr<view_cache_entry>> view_cache;
+
+    static std::shared_ptr<view_cache_entry> get_view_cache_entry(Ref<BinaryView> view)
+    {
+        std::lock_guard<std::mutex> guard(view_cache_lock);
+
+        std::shared_ptr<view_cache_entry>& entry = view_cache[view->GetObject()];
+
+        if (!entry)
+        {
+            entry = std::make_shared<view_cache_entry>();
+
+            view->RegisterNotification(&entry->notification);
+        }
+
+        return entry;
+    }
+
+    static void save_view_data(
+        Ref<BackgroundTask> /*task*/, Ref<BinaryView> view, std::shared_ptr<const view_data> data)
+    {
+        save_view_cache(view, *data);
+    }
+
+    std::shared_ptr<const view_data> get_view_data(Ref<BinaryView> view)
+    {
+        std::shared_ptr<view_cache_entry> entry = get_view_cache_entry(view);
+
+        std::lock_guard<std::mutex> build_guard(entry->build_lock);
+
+        std::shared_ptr<const view_data> previous;
+        std::vector<address_range> dirty;
+
+        {
+            std::lock_guard<std::mutex> guard(entry->data_lock);
+
+            if (entry->data && entry->dirty.empty())
+            {
+                return entry->data;
+            }
+
+            previous = entry->data;
+            dirty.swap(entry->dirty);
+        }
+
+        // Anything changed while this runs is marked dirty again, and picked up by the next call
+        std::shared_ptr<const view_data> result;
+
+        if (previous)
+        {
+            result = std::make_shared<const view_data>(view, *previous, std::move(dirty));
+        }
+        else if (is_disk_cache_enabled(view))
+        {
+            // Only found if the view's file is unchanged since it was saved, so it's used without reading the view
+            result = load_view_cache(view);
+
+            if (!result)
+            {
+                result = std::make_shared<const view_data>(view);
+
+                Ref<BackgroundTaskThread> task = new BackgroundTaskThread("Saving view cache");
+
+                task->Run(&save_view_data, view, result);
+            }
+        }
+        else
+        {
+            result = std::make_shared<const view_data>(view);
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(entry->data_lock);
+
+            entry->data = result;
+
+            // Don't keep the old snapshot alive just for its index
+            entry->index.reset();
+        }
+
+        return result;
+    }
+
+    static void build_gram_index(
+        Ref<BackgroundTask> /*task*/, std::shared_ptr<view_cache_entry> entry, std::shared_ptr<const view_data> data)
+    {
+        using stopwatch = std::chrono::steady_clock;
+
+        const auto start_time = stopwatch::now();
+
+        std::shared_ptr<const gram_index> index = std::make_shared<const gram_index>(data);
+
+        const auto end_time = stopwatch::now();
+
+        BinjaLog(InfoLog, "Indexed view in {} ms ({} MiB)",
+            std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time).count(),
+            index->size_in_bytes() / (1024 * 1024));
+
+        std::lock_guard<std::mutex> guard(entry->data_lock);
+
+        if (entry->indexing == data)
+        {
+            entry->indexing.reset();
+
+            // The view may have changed while this was building
+            if (entry->data == data)
+            {
+                entry->index = std::move(index);
+            }
+        }
+    }
+
+    std::shared_ptr<const gram_index> get_gram_index(Ref<BinaryView> view, const std::shared_ptr<const view_data>& data)
+    {
+        if (!Settings::Instance()->Get<bool>("pattern.indexView", view))
+        {
+            return nullptr;
+        }
+
+        std::shared_ptr<view_cache_entry> entry = get_view_cache_entry(view);
+
+        std::lock_guard<std::mutex> guard(entry->data_lock);
+
+        if (entry->index && (entry->index->data() == data))
+        {
+            return entry->index;
+        }
+
+        // Only the latest snapshot is worth indexing
+        if ((entry->data == data) && (entry->indexing != data))
+        {
+            entry->indexing = data;
+
+            Ref<BackgroundTaskThread> task = new BackgroundTaskThread("Indexing view");
+
+            task->Run(&build_gram_index, entry, data);
+        }
+
+        return nullptr;
+    }
+
+    // Views aren't referenced, so the list doesn't keep them open. Each is found again through its file when needed.
+    // The handle is only compared, never referenced, since the view may already be being destroyed.
+    struct open_view
+    {
+        Ref<FileMetadata> file;
+        std::string type;
+        BNBinaryView* handle;
+    };
+
+    // Entries are removed by release_view_data once the view is destroyed
+    static std::mutex open_views_lock;
+    static std::vector<open_view> open_views;
+
+    void register_open_view(BinaryView* view)
+    {
+        std::lock_guard<std::mutex> guard(open_views_lock);
+
+        for (const open_view& open : open_views)
+        {
+            if (open.handle == view->GetObject())
+            {
+                return;
+            }
+        }
+
+        open_views.push_back({view->GetFile(), view->GetTypeName(), view->GetObject()});
+    }
+
+    std::vector<Ref<BinaryView>> get_open_views()
+    {
+        std::lock_guard<std::mutex> guard(open_views_lock);
+
+        std::vector<Ref<BinaryView>> results;
+
+        for (const open_view& open : open_views)
+        {
+            // The file no longer has the view once it has been closed
+            Ref<BinaryView> view = open.file->GetViewOfType(open.type);
+
+            if (view && (view->GetObject() == open.handle))
+            {
+                results.push_back(view);
+            }
+        }
+
+        return results;
+    }
+
+    void release_view_data(BinaryView* view)
+    {
+        {
+            std::lock_guard<std::mutex> guard(open_views_lock);
+
+            const auto same_view = [view](const open_view& open) { return open.handle == view->GetObject(); };
+
+            open_views.erase(std::remove_if(open_views.begin(), open_views.end(), same_view), open_views.end());
+        }
+
+        std::shared_ptr<view_cache_entry> entry;
+
+        {
+            std::lock_guard<std::mutex> guard(view_cache_lock);
+
+            auto iter = view_cache.find(view->GetObject());
+
+            if (iter == view_cache.end())
+            {
+                return;
+            }
+
+            entry = std::move(iter->second);
+
+            view_cache.erase(iter);
+        }
+
+        view->UnregisterNotification(&entry->notification);
+    }
+
+    void view_cache_destructor::DestructBinaryView(BinaryView* view)
+    {
+        release_view_data(view);
+    }
+} // namespace brick
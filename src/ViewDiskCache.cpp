@@ -0,0 +1,471 @@
+/*
+    Copyright 2018 Brick
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+    and associated documentation files (the "Software"), to deal in the Software without restriction,
+    including without limitation the rights to use, copy, modify, merge, publish, distribute,
+    sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all copies or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+    BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "ViewDiskCache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+
+namespace brick
+{
+    // "BNPATVDC"
+    constexpr const uint64_t view_cache_magic = 0x4344565441504E42;
+
+    // Increment whenever the layout of the file changes
+    constexpr const uint32_t view_cache_version = 2;
+
+    struct view_cache_header
+    {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t segment_count;
+
+        // See get_cache_key
+        uint64_t key;
+        uint64_t file_size;
+        uint64_t histogram_offset;
+    };
+
+    struct view_cache_segment
+    {
+        uint64_t start;
+        uint64_t length;
+        uint64_t data_length;
+        uint64_t data_offset;
+        uint64_t page_hashes_offset;
+
+        // Hash of the page hashes
+        uint64_t content_hash;
+    };
+
+    // total, then 0x100 byte counts, then 0x10000 pair counts
+    constexpr const size_t view_cache_histogram_size = (1 + 0x100 + 0x10000) * sizeof(uint64_t);
+
+    static uint64_t page_count(uint64_t data_length)
+    {
+        return (data_length + view_page_size - 1) / view_page_size;
+    }
+
+    static std::vector<uint64_t> hash_pages(const uint8_t* data, uint64_t data_length)
+    {
+        std::vector<uint64_t> results(static_cast<size_t>(page_count(data_length)));
+
+        for (uint64_t i = 0; i < results.size(); ++i)
+        {
+            const uint64_t offset = i * view_page_size;
+
+            results[i] = hash_bytes(data + offset, static_cast<size_t>(std::min(view_page_size, data_length - offset)));
+        }
+
+        return results;
+    }
+
+    // Hash of the view's file name, the size and modification time of that file, and the segment layout.
+    // The cache holds what the file on disk contains, so a view with unsaved changes has no key.
+    static bool get_cache_key(Ref<BinaryView> view, const std::vector<segment_layout>& layout, uint64_t& key)
+    {
+        Ref<FileMetadata> metadata = view->GetFile();
+
+        if (metadata->IsModified())
+        {
+            return false;
+        }
+
+        const std::string file_name = metadata->GetFilename();
+        const std::filesystem::path path = std::filesystem::u8path(file_name);
+
+        std::error_code error;
+
+        const uint64_t file_size = std::filesystem::file_size(path, error);
+
+        if (error)
+        {
+            return false;
+        }
+
+        const int64_t file_time = std::filesystem::last_write_time(path, error).time_since_epoch().count();
+
+        if (error)
+        {
+            return false;
+        }
+
+        key = hash_bytes(file_name.data(), file_name.size());
+        key = hash_bytes(&file_size, sizeof(file_size), key);
+        key = hash_bytes(&file_time, sizeof(file_time), key);
+
+        for (const segment_layout& segment : layout)
+        {
+            key = hash_bytes(&segment, sizeof(segment), key);
+        }
+
+        return true;
+    }
+
+    static std::filesystem::path get_cache_directory()
+    {
+        return std::filesystem::u8path(GetUserDirectory()) / "pattern-cache";
+    }
+
+    // Each version of a view's cache is named after its contents, so a file is never replaced while it's mapped
+    static std::filesystem::path get_cache_path(uint64_t key, uint64_t content_hash)
+    {
+        return get_cache_directory() / fmt::format("{:016X}-{:016X}.bin", key, content_hash);
+    }
+
+    struct cache_file_info
+    {
+        std::filesystem::path path;
+        std::filesystem::file_time_type time;
+        uint64_t size;
+    };
+
+    // Every view cache, or only the versions of the one with the key
+    static std::vector<cache_file_info> find_cache_files(const uint64_t* key)
+    {
+        std::vector<cache_file_info> results;
+
+        const std::string prefix = key ? fmt::format("{:016X}-", *key) : std::string();
+
+        std::error_code error;
+
+        for (std::filesystem::directory_iterator iter(get_cache_directory(), error), end; !error && (iter != end);
+             iter.increment(error))
+        {
+            const std::filesystem::path& path = iter->path();
+            const std::string name = path.filename().u8string();
+
+            if ((path.extension() != ".bin") || name.compare(0, prefix.size(), prefix))
+            {
+                continue;
+            }
+
+            std::error_code file_error;
+
+            cache_file_info info {path, iter->last_write_time(file_error), iter->file_size(file_error)};
+
+            if (!file_error)
+            {
+                results.push_back(std::move(info));
+            }
+        }
+
+        // Most recently used first
+        std::sort(results.begin(), results.end(),
+            [](const cache_file_info& lhs, const cache_file_info& rhs) { return lhs.time > rhs.time; });
+
+        return results;
+    }
+
+    // Removes the older versions of the view's cache, then the least recently used caches until they fit in the limit.
+    // Caches still mapped by another view can be removed too, since they are opened with delete sharing.
+    static void evict_view_caches(Ref<BinaryView> view, uint64_t key, const std::filesystem::path& keep)
+    {
+        std::error_code error;
+
+        for (const cache_file_info& file : find_cache_files(&key))
+        {
+            if (file.path != keep)
+            {
+                std::filesystem::remove(file.path, error);
+            }
+        }
+
+        const uint64_t limit = Settings::Instance()->Get<uint64_t>("pattern.diskCacheLimit", view) * 1024 * 1024;
+
+        uint64_t total = 0;
+
+        for (const cache_file_info& file : find_cache_files(nullptr))
+        {
+            total += file.size;
+
+            if ((total > limit) && (file.path != keep))
+            {
+                std::filesystem::remove(file.path, error);
+            }
+        }
+    }
+
+    static uint64_t align_page(uint64_t offset)
+    {
+        return (offset + view_page_size - 1) & ~(view_page_size - 1);
+    }
+
+    bool is_disk_cache_enabled(Ref<BinaryView> view)
+    {
+        return Settings::Instance()->Get<bool>("pattern.diskCache", view);
+    }
+
+    std::shared_ptr<const view_data> load_view_cache(Ref<BinaryView> view)
+    {
+        const std::vector<segment_layout> layout = get_segment_layout(view);
+
+        uint64_t key = 0;
+
+        if (!get_cache_key(view, layout, key))
+        {
+            return nullptr;
+        }
+
+        const std::vector<cache_file_info> versions = find_cache_files(&key);
+
+        if (versions.empty())
+        {
+            return nullptr;
+        }
+
+        const std::filesystem::path& path = versions.front().path;
+
+        std::error_code error;
+
+        // Keep it from being evicted before less recently used caches
+        std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+
+        std::shared_ptr<mapped_file> file = std::make_shared<mapped_file>(path.u8string());
+
+        if (!*file || (file->size() < sizeof(view_cache_header)))
+        {
+            return nullptr;
+        }
+
+        view_cache_header header;
+        std::memcpy(&header, file->data(), sizeof(header));
+
+        if ((header.magic != view_cache_magic) || (header.version != view_cache_version) || (header.key != key) ||
+            (header.file_size != file->size()) || (header.segment_count != layout.size()) ||
+            (header.histogram_offset > file->size()) ||
+            (file->size() - header.histogram_offset < view_cache_histogram_size) ||
+            ((file->size() - sizeof(header)) / sizeof(view_cache_segment) < header.segment_count))
+        {
+            BinjaLog(WarningLog, "Ignoring invalid view cache \"{}\"", path.u8string());
+
+            return nullptr;
+        }
+
+        std::vector<view_segment> segments;
+
+        segments.reserve(layout.size());
+
+        std::vector<uint8_t> page(view_page_size);
+
+        for (size_t i = 0; i < layout.size(); ++i)
+        {
+            view_cache_segment segment;
+            std::memcpy(&segment, file->data() + sizeof(header) + i * sizeof(segment), sizeof(segment));
+
+            const uint64_t hashes_size = page_count(segment.data_length) * sizeof(uint64_t);
+
+            if ((segment.start != layout[i].start) || (segment.length != layout[i].length) ||
+                (segment.data_length != layout[i].data_length) || (segment.data_offset > file->size()) ||
+                (segment.data_length > file->size() - segment.data_offset) ||
+                (segment.page_hashes_offset > file->size()) ||
+                (hashes_size > file->size() - segment.page_hashes_offset))
+            {
+                BinjaLog(WarningLog, "Ignoring invalid view cache \"{}\"", path.u8string());
+
+                return nullptr;
+            }
+
+            const uint8_t* data = file->data() + segment.data_offset;
+
+            // A cheap check, in case the view was changed without changing its file
+            const size_t check_length = static_cast<size_t>(std::min(view_page_size, segment.data_length));
+
+            if ((view->Read(page.data(), segment.start, check_length) != check_length) ||
+                std::memcmp(page.data(), data, check_length))
+            {
+                return nullptr;
+            }
+
+            std::vector<uint64_t> hashes(static_cast<size_t>(page_count(segment.data_length)));
+
+            std::memcpy(hashes.data(), file->data() + segment.page_hashes_offset, hashes_size);
+
+            if (hash_bytes(hashes.data(), hashes_size) != segment.content_hash)
+            {
+                BinjaLog(WarningLog, "Ignoring corrupt view cache \"{}\"", path.u8string());
+
+                return nullptr;
+            }
+
+            segments.emplace_back(segment.start, segment.length, segment.data_length, data);
+        }
+
+        std::unique_ptr<byte_histogram> histogram(new byte_histogram());
+
+        const uint8_t* histogram_data = file->data() + header.histogram_offset;
+
+        std::memcpy(&histogram->total, histogram_data, sizeof(uint64_t));
+        std::memcpy(histogram->bytes.data(), histogram_data + sizeof(uint64_t), 0x100 * sizeof(uint64_t));
+        std::memcpy(
+            histogram->pairs.data(), histogram_data + (1 + 0x100) * sizeof(uint64_t), 0x10000 * sizeof(uint64_t));
+
+        return std::make_shared<const view_data>(std::move(file), std::move(segments), std::move(histogram));
+    }
+
+    bool save_view_cache(Ref<BinaryView> view, const view_data& data)
+    {
+        std::vector<segment_layout> layout;
+
+        for (const view_segment& segment : data.segments)
+        {
+            layout.push_back({segment.start, segment.length, segment.data_length});
+        }
+
+        uint64_t key = 0;
+
+        if (!get_cache_key(view, layout, key))
+        {
+            return false;
+        }
+
+        const std::filesystem::path path = get_cache_path(key, data.content_hash());
+
+        std::error_code error;
+
+        // Already saved, and possibly mapped by a snapshot
+        if (std::filesystem::exists(path, error))
+        {
+            std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+
+            evict_view_caches(view, key, path);
+
+            return true;
+        }
+
+        std::filesystem::create_directories(path.parent_path(), error);
+
+        view_cache_header header {};
+
+        header.magic = view_cache_magic;
+        header.version = view_cache_version;
+        header.segment_count = static_cast<uint32_t>(data.segments.size());
+        header.key = key;
+
+        std::vector<view_cache_segment> segments(data.segments.size());
+        std::vector<std::vector<uint64_t>> page_hashes(data.segments.size());
+
+        uint64_t offset = sizeof(header) + segments.size() * sizeof(view_cache_segment);
+
+        header.histogram_offset = offset;
+        offset += view_cache_histogram_size;
+
+        for (size_t i = 0; i < segments.size(); ++i)
+        {
+            const view_segment& segment = data.segments[i];
+
+            page_hashes[i] = hash_pages(segment.data, segment.data_length);
+
+            segments[i].start = segment.start;
+            segments[i].length = segment.length;
+            segments[i].data_length = segment.data_length;
+            segments[i].page_hashes_offset = offset;
+            segments[i].content_hash = hash_bytes(page_hashes[i].data(), page_hashes[i].size() * sizeof(uint64_t));
+
+            offset += page_hashes[i].size() * sizeof(uint64_t);
+        }
+
+        // Keep the data page aligned, so it's mapped the same way as the view's pages
+        for (view_cache_segment& segment : segments)
+        {
+            offset = align_page(offset);
+            segment.data_offset = offset;
+            offset += segment.data_length;
+        }
+
+        header.file_size = offset;
+
+        const byte_histogram& histogram = data.histogram();
+
+        // Write to a temporary file first, so a cache is never seen half written
+        std::filesystem::path temp_path = path;
+        temp_path += ".tmp";
+
+        {
+            std::ofstream output(temp_path, std::ios::binary | std::ios::trunc);
+
+            if (!output)
+            {
+                BinjaLog(ErrorLog, "Failed to create view cache \"{}\"", temp_path.u8string());
+
+                return false;
+            }
+
+            const auto write = [&output](const void* buffer, uint64_t length) {
+                output.write(static_cast<const char*>(buffer), static_cast<std::streamsize>(length));
+            };
+
+            const auto pad_to = [&output](uint64_t target) {
+                static const char zeros[view_page_size] {};
+
+                uint64_t position = static_cast<uint64_t>(output.tellp());
+
+                if (position < target)
+                {
+                    output.write(zeros, static_cast<std::streamsize>(target - position));
+                }
+            };
+
+            write(&header, sizeof(header));
+            write(segments.data(), segments.size() * sizeof(view_cache_segment));
+
+            write(&histogram.total, sizeof(uint64_t));
+            write(histogram.bytes.data(), histogram.bytes.size() * sizeof(uint64_t));
+            write(histogram.pairs.data(), histogram.pairs.size() * sizeof(uint64_t));
+
+            for (const std::vector<uint64_t>& hashes : page_hashes)
+            {
+                write(hashes.data(), hashes.size() * sizeof(uint64_t));
+            }
+
+            for (size_t i = 0; i < segments.size(); ++i)
+            {
+                pad_to(segments[i].data_offset);
+                write(data.segments[i].data, data.segments[i].data_length);
+            }
+
+            if (!output)
+            {
+                BinjaLog(ErrorLog, "Failed to write view cache \"{}\"", temp_path.u8string());
+
+                output.close();
+                std::filesystem::remove(temp_path, error);
+
+                return false;
+            }
+        }
+
+        std::filesystem::rename(temp_path, path, error);
+
+        if (error)
+        {
+            BinjaLog(ErrorLog, "Failed to rename view cache \"{}\": {}", path.u8string(), error.message());
+
+            std::filesystem::remove(temp_path, error);
+
+            return false;
+        }
+
+        evict_view_caches(view, key, path);
+
+        return true;
+    }
+} // namespace brick
@@ -0,0 +1,140 @@
+/*
+    Copyright 2018 Brick
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+    and associated documentation files (the "Software"), to deal in the Software without restriction,
+    including without limitation the rights to use, copy, modify, merge, publish, distribute,
+    sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all copies or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+    BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "ViewStream.h"
+
+#include <future>
+
+namespace brick
+{
+    // Chunks smaller than this spend more time synchronizing than reading
+    constexpr const uint64_t min_stream_chunk_size = 1024 * 1024;
+
+    uint64_t get_scan_memory_limit(Ref<BinaryView> view)
+    {
+        uint64_t limit = Settings::Instance()->Get<uint64_t>("pattern.scanMemoryLimit", view) * 1024 * 1024;
+
+        return std::max<uint64_t>(limit, min_stream_chunk_size * 2);
+    }
+
+    bool should_stream(Ref<BinaryView> view)
+    {
+        uint64_t total = 0;
+
+        for (const address_range& range : view_ranges(view))
+        {
+            total += range.end - range.start;
+        }
+
+        return total > get_scan_memory_limit(view);
+    }
+
+    void stream_view(Ref<BinaryView> view, const std::vector<address_range>& ranges, size_t chunk_size,
+        size_t overlap, const std::function<bool(const view_region& region, size_t carry_length)>& func)
+    {
+        struct stream_chunk
+        {
+            uint64_t start;
+            size_t length;
+
+            // Whether the chunk continues the previous one
+            bool carry;
+        };
+
+        struct stream_buffer
+        {
+            view_region region;
+            size_t carry_length;
+        };
+
+        chunk_size = std::max<size_t>(chunk_size, overlap + 1);
+
+        std::vector<stream_chunk> chunks;
+
+        for (const address_range& range : ranges)
+        {
+            for (uint64_t start = range.start; start < range.end; start += chunk_size)
+            {
+                chunks.push_back({start, static_cast<size_t>(std::min<uint64_t>(chunk_size, range.end - start)),
+                    start != range.start});
+            }
+        }
+
+        if (chunks.empty())
+        {
+            return;
+        }
+
+        std::unique_ptr<uint8_t[]> buffers[2] {
+            std::unique_ptr<uint8_t[]>(new uint8_t[overlap + chunk_size]),
+            std::unique_ptr<uint8_t[]>(new uint8_t[overlap + chunk_size]),
+        };
+
+        const auto read_chunk = [&](size_t index, view_region previous) -> stream_buffer {
+            const stream_chunk& chunk = chunks[index];
+
+            uint8_t* buffer = buffers[index % 2].get();
+
+            size_t carry_length = 0;
+
+            if (chunk.carry)
+            {
+                carry_length = std::min(overlap, previous.length);
+
+                std::memcpy(buffer, previous.data + previous.length - carry_length, carry_length);
+            }
+
+            const size_t bytes_read = view->Read(buffer + carry_length, chunk.start, chunk.length);
+
+            if (bytes_read < chunk.length)
+            {
+                std::memset(buffer + carry_length + bytes_read, 0, chunk.length - bytes_read);
+            }
+
+            return {{chunk.start - carry_length, buffer, carry_length + chunk.length, 0}, carry_length};
+        };
+
+        stream_buffer current = read_chunk(0, {});
+
+        for (size_t i = 0; i < chunks.size(); ++i)
+        {
+            std::future<stream_buffer> next;
+
+            // The next chunk only writes to the other buffer, and reads the tail of this one
+            if (i + 1 < chunks.size())
+            {
+                next = std::async(std::launch::async, read_chunk, i + 1, current.region);
+            }
+
+            const bool keep_going = func(current.region, current.carry_length);
+
+            if (!next.valid())
+            {
+                break;
+            }
+
+            current = next.get();
+
+            if (!keep_going)
+            {
+                break;
+            }
+        }
+    }
+} // namespace brick
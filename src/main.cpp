@@ -21,32 +21,126 @@
 #include "PatternLoader.h"
 #include "PatternMaker.h"
 #include "PatternScanner.h"
+#include "ViewCache.h"
 
 BN_DECLARE_CORE_ABI_VERSION;
 
+static bool IsArchitectureSupported(Ref<Architecture> arch)
+{
+    if (!arch)
+    {
+        return false;
+    }
+
+    std::string arch_name = arch->GetName();
+
+    return (arch_name == "x86") || (arch_name == "x86_64");
+}
+
+static bool IsSignatureSupported(BinaryView* view, uint64_t addr)
+{
+    Ref<BasicBlock> block = view->GetRecentBasicBlockForAddress(addr);
+
+    if (!block)
+    {
+        return false;
+    }
+
+    Ref<Function> func = block->GetFunction();
+
+    return IsArchitectureSupported(func->GetArchitecture());
+}
+
+// Functions of any other architecture are reported and skipped, so only the view's own architecture is checked
+static bool IsViewSignatureSupported(BinaryView* view)
+{
+    return IsArchitectureSupported(view->GetDefaultArchitecture());
+}
+
+static bool IsRangeSignatureSupported(BinaryView* view, uint64_t /*addr*/, uint64_t /*len*/)
+{
+    return IsViewSignatureSupported(view);
+}
+
 extern "C"
 {
     BINARYNINJAPLUGIN bool CorePluginInit()
     {
+        Ref<Settings> settings = Settings::Instance();
+
+        settings->RegisterGroup("pattern", "Pattern");
+
+        settings->RegisterSetting("pattern.scanMemoryLimit",
+            R"({
+                "title" : "Scan Memory Limit",
+                "type" : "number",
+                "default" : 4096,
+                "minValue" : 2,
+                "maxValue" : 1048576,
+                "description" : "Size in MiB. Views larger than this are scanned in chunks instead of being read into memory at once, using at most this much memory.",
+                "ignore" : ["SettingsProjectScope", "SettingsResourceScope"]
+            })");
+
+        settings->RegisterSetting("pattern.indexView",
+            R"({
+                "title" : "Index Views",
+                "type" : "boolean",
+                "default" : false,
+                "description" : "Builds an index of each view in the background, so scans and signature creation don't have to read the whole view. Uses up to twice the size of the view in memory.",
+                "ignore" : ["SettingsProjectScope", "SettingsResourceScope"]
+            })");
+
+        settings->RegisterSetting("pattern.diskCache",
+            R"({
+                "title" : "Cache Views on Disk",
+                "type" : "boolean",
+                "default" : false,
+                "description" : "Saves a copy of each view's contents and byte frequencies to the user directory, so reopening it doesn't need to read the whole view again. Uses as much disk space as the view.",
+                "ignore" : ["SettingsProjectScope", "SettingsResourceScope"]
+            })");
+
+        settings->RegisterSetting("pattern.diskCacheLimit",
+            R"({
+                "title" : "View Disk Cache Limit",
+                "type" : "number",
+                "default" : 8192,
+                "minValue" : 0,
+                "maxValue" : 1048576,
+                "description" : "Size in MiB. Once the cached views take up more than this, the least recently used are removed.",
+                "ignore" : ["SettingsProjectScope", "SettingsResourceScope"]
+            })");
+
+        settings->RegisterSetting("pattern.cachePatternFiles",
+            R"({
+                "title" : "Cache Pattern Files",
+                "type" : "boolean",
+                "default" : true,
+                "description" : "Saves a compiled copy of each pattern file to the user directory, so loading it again doesn't need to parse it. The copy is replaced whenever the pattern file changes.",
+                "ignore" : ["SettingsProjectScope", "SettingsResourceScope"]
+            })");
+
         PluginCommand::Register("Pattern\\Scan for Pattern", "Scans for an array of bytes", &ScanForArrayOfBytes);
         PluginCommand::Register("Pattern\\Load Pattern File", "Loads a file containing patterns", &LoadPatternFile);
 
-        PluginCommand::RegisterForAddress("Pattern\\Create Signature", "Creates a signature", &GenerateSignature,
-            [](Ref<BinaryView> view, uint64_t addr) -> bool {
-                Ref<BasicBlock> block = view->GetRecentBasicBlockForAddress(addr);
+        PluginCommand::RegisterForAddress(
+            "Pattern\\Create Signature", "Creates a signature", &GenerateSignature, &IsSignatureSupported);
+
+        PluginCommand::RegisterForAddress("Pattern\\Create Cross-Version Signature",
+            "Creates a signature which matches once in each of several open views", &GenerateCrossSignature,
+            &IsSignatureSupported);
 
-                if (!block)
-                {
-                    return false;
-                }
+        PluginCommand::Register("Pattern\\Generate Signatures for All Functions",
+            "Creates a pattern file with a signature for every function", &GenerateAllSignatures,
+            &IsViewSignatureSupported);
 
-                Ref<Function> func = block->GetFunction();
-                Ref<Architecture> arch = func->GetArchitecture();
+        PluginCommand::RegisterForRange("Pattern\\Generate Signatures for Selected Functions",
+            "Creates a pattern file with a signature for every function in the selection", &GenerateRangeSignatures,
+            &IsRangeSignatureSupported);
 
-                std::string arch_name = arch->GetName();
+        BinaryViewType::RegisterBinaryViewInitialAnalysisCompletionEvent(&brick::register_open_view);
 
-                return (arch_name == "x86") || (arch_name == "x86_64");
-            });
+        // Registers itself for the lifetime of the plugin
+        static brick::view_cache_destructor view_destructor;
 
         BinjaLog(InfoLog, "Loaded binja-pattern");
 
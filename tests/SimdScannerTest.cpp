@@ -0,0 +1,189 @@
+/*
+    Copyright 2018 Brick
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+    and associated documentation files (the "Software"), to deal in the Software without restriction,
+    including without limitation the rights to use, copy, modify, merge, publish, distribute,
+    sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all copies or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+    BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+// Compares simd_scanner against mem::default_scanner on random data, to catch any matches it misses or invents
+
+#include "SimdScanner.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+
+namespace brick
+{
+    template <typename Scanner>
+    static std::vector<size_t> find_all(const Scanner& scanner, const uint8_t* data, size_t length)
+    {
+        std::vector<size_t> results;
+
+        scanner(mem::region(data, length), [&](mem::pointer result) {
+            results.push_back(static_cast<size_t>(result.as<const uint8_t*>() - data));
+
+            return false;
+        });
+
+        return results;
+    }
+
+    struct test_context
+    {
+        std::mt19937_64 rng {0x1F9F1};
+
+        size_t cases {0};
+        size_t failures {0};
+        size_t matches {0};
+
+        size_t random(size_t limit)
+        {
+            return static_cast<size_t>(rng() % limit);
+        }
+
+        // Data with only a few distinct byte values, so random patterns often match
+        std::vector<uint8_t> random_data(size_t length)
+        {
+            std::vector<uint8_t> data(length);
+
+            const size_t values = 1 + random(6);
+
+            for (uint8_t& value : data)
+            {
+                value = static_cast<uint8_t>(random(values) * 0x35);
+            }
+
+            return data;
+        }
+
+        // Copies length bytes at offset, masking some of them.
+        // The first byte is always (partly) known, since a pattern can't be only wildcards.
+        mem::pattern random_pattern(const std::vector<uint8_t>& data, size_t offset, size_t length)
+        {
+            std::vector<uint8_t> bytes(length);
+            std::vector<uint8_t> masks(length);
+
+            for (size_t i = 0; i < length; ++i)
+            {
+                const size_t kind = random(8);
+
+                masks[i] = (kind == 0) ? 0x00 : (kind == 1) ? 0xF0 : (kind == 2) ? 0x0F : 0xFF;
+                bytes[i] = ((offset + i) < data.size()) ? data[offset + i] : static_cast<uint8_t>(random(0x100));
+            }
+
+            if (masks[0] == 0)
+            {
+                masks[0] = 0xFF;
+            }
+
+            for (size_t i = 0; i < length; ++i)
+            {
+                bytes[i] &= masks[i];
+            }
+
+            return mem::pattern(bytes.data(), masks.data(), length);
+        }
+
+        // Checks every level the CPU supports, not just the one it would pick
+        void check(const char* name, const mem::pattern& pattern, const uint8_t* data, size_t length)
+        {
+            const std::vector<size_t> expected = find_all(mem::default_scanner(pattern), data, length);
+
+            ++cases;
+            matches += expected.size();
+
+            for (int level = 0; level <= static_cast<int>(supported_simd_level()); ++level)
+            {
+                const simd_scanner scanner(pattern, nullptr, static_cast<simd_level>(level));
+                const std::vector<size_t> actual = find_all(scanner, data, length);
+
+                if (actual != expected)
+                {
+                    if (++failures <= 10)
+                    {
+                        std::printf("%s (%s): length %zu, pattern %s: found %zu matches, expected %zu\n", name,
+                            to_string(scanner.level()), length, pattern.to_string().c_str(), actual.size(),
+                            expected.size());
+                    }
+                }
+            }
+        }
+    };
+
+    // Random buffers and masked patterns, scanned from an unaligned start
+    static void test_random(test_context& context)
+    {
+        for (size_t i = 0; i < 4000; ++i)
+        {
+            std::vector<uint8_t> data = context.random_data(1 + context.random(4096));
+
+            const mem::pattern pattern =
+                context.random_pattern(data, context.random(data.size()), 1 + context.random(24));
+
+            const size_t start = context.random(std::min<size_t>(data.size(), 64));
+
+            context.check("random", pattern, data.data() + start, data.size() - start);
+        }
+    }
+
+    // Copies of one pattern planted across 16, 32 and 64 byte boundaries, in otherwise unmatched data
+    static void test_boundaries(test_context& context)
+    {
+        for (size_t i = 0; i < 4000; ++i)
+        {
+            const size_t length = 2 + context.random(40);
+
+            std::vector<uint8_t> needle(length);
+
+            for (uint8_t& value : needle)
+            {
+                value = static_cast<uint8_t>(context.random(0x100));
+            }
+
+            std::vector<uint8_t> data(512, 0xCC);
+
+            for (size_t j = 0; j < 4; ++j)
+            {
+                const size_t block = size_t(16) << context.random(3);
+                const size_t boundary = block * (1 + context.random((data.size() - 64) / block));
+                const size_t offset = boundary - 1 - context.random(std::min(length - 1, block));
+
+                std::copy(needle.begin(), needle.end(), data.begin() + offset);
+            }
+
+            const mem::pattern pattern = context.random_pattern(needle, 0, length);
+
+            // Also scan with the end cutting through a match
+            const size_t end = data.size() - context.random(length + 1);
+
+            context.check("boundary", pattern, data.data(), end);
+        }
+    }
+} // namespace brick
+
+int main()
+{
+    brick::test_context context;
+
+    std::printf("Supported level: %s\n", brick::to_string(brick::supported_simd_level()));
+
+    brick::test_random(context);
+    brick::test_boundaries(context);
+
+    std::printf("%zu cases, %zu matches, %zu failures\n", context.cases, context.matches, context.failures);
+
+    return (context.failures == 0) ? 0 : 1;
+}